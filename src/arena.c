@@ -0,0 +1,79 @@
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+// small enough that the trees of many small tiles don't each pin a large chunk,
+// chunks double from here so big trees reach large chunks quickly anyway
+#define ARENA_MIN_CHUNK 1024
+#define ARENA_MAX_CHUNK (64 * 1024 * 1024)
+
+struct ArenaChunk {
+    ArenaChunk *next;
+    size_t capacity;
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+static ArenaChunk *arena_chunk_new(size_t capacity) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + capacity);
+    if (!chunk) {
+        return nullptr;
+    }
+
+    chunk->next = nullptr;
+    chunk->capacity = capacity;
+    chunk->used = 0;
+    return chunk;
+}
+
+void arena_init(Arena *arena) {
+    arena->first = nullptr;
+    arena->current = nullptr;
+}
+
+void arena_deinit(Arena *arena) {
+    ArenaChunk *chunk = arena->first;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena_init(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    ArenaChunk *chunk = arena->current;
+    if (!chunk || chunk->capacity - chunk->used < size) {
+        // every new chunk doubles the previous one, so the chunk count stays
+        // logarithmic in the number of allocations
+        size_t capacity = chunk ? chunk->capacity * 2 : ARENA_MIN_CHUNK;
+        if (capacity > ARENA_MAX_CHUNK) {
+            capacity = ARENA_MAX_CHUNK;
+        }
+        if (capacity < size) {
+            capacity = size;
+        }
+
+        ArenaChunk *next = arena_chunk_new(capacity);
+        if (!next) {
+            return nullptr;
+        }
+
+        if (chunk) {
+            chunk->next = next;
+        } else {
+            arena->first = next;
+        }
+        chunk = next;
+    }
+
+    arena->current = chunk;
+    void *memory = &chunk->data[chunk->used];
+    chunk->used += size;
+    return memory;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+typedef struct ArenaChunk ArenaChunk;
+
+// Bump allocator over a list of growing chunks. Nothing is freed individually,
+// arena_deinit releases every allocation at once.
+typedef struct {
+    ArenaChunk *first;
+    ArenaChunk *current;
+} Arena;
+
+void arena_init(Arena *arena);
+void arena_deinit(Arena *arena);
+
+// returns nullptr when a new chunk can not be allocated
+void *arena_alloc(Arena *arena, size_t size);
@@ -0,0 +1,230 @@
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "clock.h"
+#include "headless.h"
+#include "pool.h"
+#include "stb_ds.h"
+
+typedef struct {
+    const Options *options;
+    char **inputs;
+    // one per input, nullptr when the input has no output of its own
+    char **outputs;
+    pthread_mutex_t mutex;
+    size_t failed;
+} Batch;
+
+static bool is_image_file(const char *name) {
+    static const char *extensions[] = { ".jpg", ".jpeg", ".png", ".bmp", ".tga", ".gif", ".psd", ".hdr", ".pic", ".ppm", ".pgm" };
+
+    const char *dot = strrchr(name, '.');
+    if (!dot) {
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++) {
+        if (strcasecmp(dot, extensions[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static char *join_path(const char *directory, const char *name) {
+    size_t length = strlen(directory) + 1 + strlen(name) + 1;
+    char *path = malloc(length);
+    if (path) {
+        snprintf(path, length, "%s/%s", directory, name);
+    }
+    return path;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool collect_directory(char ***inputs, const char *directory) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        fprintf(stderr, "Failed to open directory %s\n", directory);
+        return false;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.' || !is_image_file(entry->d_name)) {
+            continue;
+        }
+
+        char *path = join_path(directory, entry->d_name);
+        if (!path) {
+            fprintf(stderr, "Failed to malloc path\n");
+            closedir(dir);
+            return false;
+        }
+        arrpush(*inputs, path);
+    }
+    closedir(dir);
+
+    qsort(*inputs, arrlen(*inputs), sizeof(char *), compare_paths);
+    return true;
+}
+
+static bool collect_list(char ***inputs, const char *list) {
+    FILE *file = fopen(list, "r");
+    if (!file) {
+        fprintf(stderr, "Failed to open list %s\n", list);
+        return false;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        char *path = strdup(line);
+        if (!path) {
+            fprintf(stderr, "Failed to malloc path\n");
+            fclose(file);
+            return false;
+        }
+        arrpush(*inputs, path);
+    }
+    fclose(file);
+
+    return true;
+}
+
+// <output directory>/<input file name>.<format>, the source extension keeps
+// owl.jpg and owl.png of one directory apart
+static char *output_path(const Options *options, const char *input) {
+    const char *name = strrchr(input, '/');
+    name = name ? name + 1 : input;
+
+    size_t length = strlen(options->output) + 1 + strlen(name) + 1 + strlen(options->format) + 1;
+    char *path = malloc(length);
+    if (path) {
+        snprintf(path, length, "%s/%s.%s", options->output, name, options->format);
+    }
+    return path;
+}
+
+// Assigns every input its output before anything runs. Inputs of a list can
+// still share a file name across directories, those after the first would
+// overwrite its result concurrently and get no output, so they fail instead.
+static bool claim_outputs(Batch *batch) {
+    struct { char *key; size_t value; } *claimed = nullptr;
+
+    bool ok = true;
+    for (size_t i = 0; i < (size_t)arrlen(batch->inputs) && ok; i++) {
+        char *output = output_path(batch->options, batch->inputs[i]);
+        if (!output) {
+            fprintf(stderr, "Failed to malloc path\n");
+            ok = false;
+            break;
+        }
+
+        ptrdiff_t index = shgeti(claimed, output);
+        if (index >= 0) {
+            fprintf(stderr, "%s: %s is already the output of %s\n", batch->inputs[i], output, batch->inputs[claimed[index].value]);
+            free(output);
+            output = nullptr;
+        } else {
+            shput(claimed, output, i);
+        }
+        arrpush(batch->outputs, output);
+    }
+
+    shfree(claimed);
+    return ok;
+}
+
+static void batch_task(void *context, size_t index) {
+    Batch *batch = context;
+    const char *input = batch->inputs[index];
+
+    uint64_t start = clock_now_ns();
+    HeadlessReport report = {0};
+    const char *output = batch->outputs[index];
+    // images already run in parallel, so each one is rasterized serially
+    bool ok = output && headless_run(batch->options, input, output, nullptr, &report);
+    uint64_t elapsed = clock_now_ns() - start;
+
+    pthread_mutex_lock(&batch->mutex);
+    if (ok) {
+        fprintf(stdout, "%s: %.1f ms (load %.1f, refine %.1f, write %.1f), %zu splits\n",
+            input, elapsed / 1e6, report.load / 1e6, report.refine / 1e6, report.write / 1e6, report.splits);
+    } else {
+        fprintf(stdout, "%s: failed\n", input);
+        batch->failed++;
+    }
+    fflush(stdout);
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+bool batch_run(const Options *options) {
+    struct stat info;
+    if (stat(options->input, &info) != 0) {
+        fprintf(stderr, "Failed to stat %s\n", options->input);
+        return false;
+    }
+
+    if (mkdir(options->output, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create output directory %s\n", options->output);
+        return false;
+    }
+
+    Batch batch = {
+        .options = options,
+        .inputs = nullptr,
+        .outputs = nullptr,
+        .failed = 0
+    };
+
+    bool ok = S_ISDIR(info.st_mode) ? collect_directory(&batch.inputs, options->input) : collect_list(&batch.inputs, options->input);
+    ok = ok && claim_outputs(&batch);
+
+    size_t count = arrlen(batch.inputs);
+    size_t threads = options->threads < count ? options->threads : count;
+
+    Pool pool;
+    if (ok && count > 0) {
+        ok = pool_init(&pool, threads);
+    }
+
+    if (ok && count > 0) {
+        pthread_mutex_init(&batch.mutex, nullptr);
+
+        uint64_t start = clock_now_ns();
+        pool_run(&pool, batch_task, &batch, count);
+        uint64_t elapsed = clock_now_ns() - start;
+
+        fprintf(stdout, "%zu images, %zu failed, %zu threads, %.2f s (%.1f images/s)\n",
+            count, batch.failed, threads, elapsed / 1e9, count / (elapsed / 1e9));
+
+        pthread_mutex_destroy(&batch.mutex);
+        pool_deinit(&pool);
+        ok = batch.failed == 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        free(batch.inputs[i]);
+    }
+    for (size_t i = 0; i < (size_t)arrlen(batch.outputs); i++) {
+        free(batch.outputs[i]);
+    }
+    arrfree(batch.inputs);
+    arrfree(batch.outputs);
+
+    return ok;
+}
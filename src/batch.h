@@ -0,0 +1,8 @@
+#pragma once
+
+#include "options.h"
+
+// Runs the headless pipeline over every image of a directory (or a file listing
+// one path per line) on a pool of worker threads, writing the results into the
+// output directory and printing the timings of each image.
+bool batch_run(const Options *options);
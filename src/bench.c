@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+#include "clock.h"
+#include "heap.h"
+
+#define BENCH_QUADS 4096
+
+static uint32_t bench_random(uint32_t *state) {
+    // xorshift32, the same sequence on every run
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static bool bench_heap(const char *name, HeapKind kind, size_t buckets, ScoreKind score, Quad *quads, size_t splits) {
+    Heap heap;
+    if (kind == HEAP_BUCKET) {
+        if (!heap_init_buckets(&heap, buckets, score)) {
+            fprintf(stderr, "%s: failed to allocate buckets\n", name);
+            return false;
+        }
+    } else {
+        heap_init(&heap, kind, score);
+    }
+
+    uint32_t state = 0x9E3779B9;
+    uint64_t start = clock_now_ns();
+
+    bool ok = heap_push(&heap, &quads[0]);
+    for (size_t i = 0; i < splits && ok; i++) {
+        heap_pop(&heap);
+
+        Quad *children[4];
+        for (size_t j = 0; j < 4; j++) {
+            children[j] = &quads[bench_random(&state) % BENCH_QUADS];
+        }
+        ok = heap_push_many(&heap, children, 4);
+    }
+
+    uint64_t elapsed = clock_now_ns() - start;
+
+    if (ok) {
+        fprintf(stdout, "%-8s %zu splits: %8.1f ms, %6.1f ns/split, %zu nodes left\n",
+            name, splits, elapsed / 1e6, (double)elapsed / splits, heap.length);
+    } else {
+        fprintf(stderr, "%s: failed to grow heap\n", name);
+    }
+
+    heap_deinit(&heap);
+    return ok;
+}
+
+bool bench_heaps(size_t splits, size_t buckets, ScoreKind score) {
+    static Quad quads[BENCH_QUADS];
+
+    uint32_t state = 0x2545F491;
+    for (size_t i = 0; i < BENCH_QUADS; i++) {
+        uint32_t width = 5 + bench_random(&state) % 2048;
+        uint32_t height = 5 + bench_random(&state) % 2048;
+
+        quads[i] = (Quad) {
+            .boundary = (Boundary) {
+                .box = (Box) { .left = 0, .right = width, .top = 0, .bottom = height },
+                .area = (uint64_t)width * height
+            },
+            .average_color = (AverageColor) {
+                .error = (bench_random(&state) % 10000) / 100.0f
+            }
+        };
+    }
+
+    return bench_heap("binary", HEAP_BINARY, buckets, score, quads, splits)
+        && bench_heap("4ary", HEAP_QUATERNARY, buckets, score, quads, splits)
+        && bench_heap("bucket", HEAP_BUCKET, buckets, score, quads, splits);
+}
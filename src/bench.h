@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "score.h"
+
+// Times every heap kind on the refinement pattern, one pop followed by four
+// pushes per split, over synthetic quads and prints the results.
+bool bench_heaps(size_t splits, size_t buckets, ScoreKind score);
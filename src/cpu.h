@@ -0,0 +1,25 @@
+#pragma once
+
+// Runtime CPU feature checks for the hand vectorized kernels. Kernels are compiled
+// with per function target attributes so the rest of the build keeps the
+// baseline instruction set and every kernel has a scalar fallback.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CPU_X86 1
+#endif
+
+static inline bool cpu_has_avx2(void) {
+#ifdef CPU_X86
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+static inline bool cpu_has_sse41(void) {
+#ifdef CPU_X86
+    return __builtin_cpu_supports("sse4.1");
+#else
+    return false;
+#endif
+}
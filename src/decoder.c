@@ -0,0 +1,370 @@
+#include <ctype.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "stb_image.h"
+
+#ifdef QTA_HAVE_JPEG
+#include <jpeglib.h>
+#endif
+
+#ifdef QTA_HAVE_PNG
+#include <png.h>
+#endif
+
+// Reads the next decimal number of a PPM header, skipping whitespace and
+// comments. Returns false at the end of the file or on anything else.
+static bool ppm_read_number(FILE *file, long *value) {
+    int c = fgetc(file);
+    while (c == '#' || isspace(c)) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(file);
+            }
+        }
+        c = fgetc(file);
+    }
+
+    if (!isdigit(c)) {
+        return false;
+    }
+
+    *value = 0;
+    while (isdigit(c)) {
+        *value = *value * 10 + (c - '0');
+        if (*value > INT_MAX) {
+            return false;
+        }
+        c = fgetc(file);
+    }
+
+    // exactly one whitespace character separates the header from the samples
+    return isspace(c);
+}
+
+// binary PPM with 8 bit samples, read straight from the file a row at a time
+static bool ppm_open(Decoder *decoder, FILE *file) {
+    decoder->state = file;
+
+    long columns, rows, maxval;
+    if (fgetc(file) != 'P' || fgetc(file) != '6') {
+        return false;
+    }
+    if (!ppm_read_number(file, &columns) || !ppm_read_number(file, &rows) || !ppm_read_number(file, &maxval)) {
+        return false;
+    }
+    if (columns == 0 || rows == 0 || maxval != 255) {
+        return false;
+    }
+
+    decoder->width = columns;
+    decoder->height = rows;
+    return true;
+}
+
+static bool ppm_read_row(Decoder *decoder, uint8_t *row) {
+    return fread(row, 3, decoder->width, decoder->state) == (size_t)decoder->width;
+}
+
+static void ppm_close(Decoder *decoder) {
+    fclose(decoder->state);
+}
+
+static const DecoderBackend PPM_BACKEND = {
+    .name = "ppm",
+    .open = ppm_open,
+    .read_row = ppm_read_row,
+    .close = ppm_close
+};
+
+// stb_image can not stream, it decodes the whole image on open
+static bool stb_open(Decoder *decoder, FILE *file) {
+    decoder->state = stbi_load_from_file(file, &decoder->width, &decoder->height, nullptr, 3);
+    fclose(file);
+    return decoder->state != nullptr;
+}
+
+static bool stb_read_row(Decoder *decoder, uint8_t *row) {
+    const uint8_t *pixels = decoder->state;
+    size_t length = (size_t)decoder->width * 3;
+    memcpy(row, &pixels[decoder->row * length], length);
+    return true;
+}
+
+static void stb_close(Decoder *decoder) {
+    stbi_image_free(decoder->state);
+}
+
+static const DecoderBackend STB_BACKEND = {
+    .name = "stb_image",
+    .open = stb_open,
+    .read_row = stb_read_row,
+    .close = stb_close
+};
+
+#ifdef QTA_HAVE_JPEG
+
+// libjpeg reports errors through a callback that must not return, so it jumps
+// back into whichever call is running
+typedef struct {
+    struct jpeg_decompress_struct info;
+    struct jpeg_error_mgr error;
+    jmp_buf jump;
+    FILE *file;
+} JpegState;
+
+static void jpeg_error_exit(j_common_ptr info) {
+    JpegState *state = (JpegState *)info;
+    char message[JMSG_LENGTH_MAX];
+    info->err->format_message(info, message);
+    fprintf(stderr, "libjpeg: %s\n", message);
+    longjmp(state->jump, 1);
+}
+
+static bool jpeg_open(Decoder *decoder, FILE *file) {
+    JpegState *state = calloc(1, sizeof(JpegState));
+    if (!state) {
+        fclose(file);
+        return false;
+    }
+    decoder->state = state;
+    state->file = file;
+
+    state->info.err = jpeg_std_error(&state->error);
+    state->error.error_exit = jpeg_error_exit;
+    jpeg_create_decompress(&state->info);
+    if (setjmp(state->jump)) {
+        return false;
+    }
+
+    jpeg_stdio_src(&state->info, file);
+    jpeg_read_header(&state->info, TRUE);
+    state->info.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&state->info);
+
+    if (state->info.output_width > INT_MAX || state->info.output_height > INT_MAX) {
+        return false;
+    }
+    decoder->width = state->info.output_width;
+    decoder->height = state->info.output_height;
+    return true;
+}
+
+static bool jpeg_read_row(Decoder *decoder, uint8_t *row) {
+    JpegState *state = decoder->state;
+    if (setjmp(state->jump)) {
+        return false;
+    }
+
+    JSAMPROW rows[1] = { row };
+    return jpeg_read_scanlines(&state->info, rows, 1) == 1;
+}
+
+static void jpeg_close(Decoder *decoder) {
+    JpegState *state = decoder->state;
+    if (!state) {
+        return;
+    }
+
+    jpeg_destroy_decompress(&state->info);
+    fclose(state->file);
+    free(state);
+}
+
+static const DecoderBackend JPEG_BACKEND = {
+    .name = "libjpeg",
+    .open = jpeg_open,
+    .read_row = jpeg_read_row,
+    .close = jpeg_close
+};
+
+#endif
+
+#ifdef QTA_HAVE_PNG
+
+typedef struct {
+    png_structp png;
+    png_infop info;
+    FILE *file;
+} PngState;
+
+static bool png_open(Decoder *decoder, FILE *file) {
+    PngState *state = calloc(1, sizeof(PngState));
+    if (!state) {
+        fclose(file);
+        return false;
+    }
+    decoder->state = state;
+    state->file = file;
+
+    state->png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    state->info = state->png ? png_create_info_struct(state->png) : nullptr;
+    if (!state->info || setjmp(png_jmpbuf(state->png))) {
+        return false;
+    }
+
+    png_init_io(state->png, file);
+    png_read_info(state->png, state->info);
+
+    // interlaced rows only come out complete after every pass, leave those to stb
+    if (png_get_interlace_type(state->png, state->info) != PNG_INTERLACE_NONE) {
+        return false;
+    }
+
+    // whatever the stored format, hand out 8 bit RGB
+    png_set_expand(state->png);
+    png_set_strip_16(state->png);
+    png_set_strip_alpha(state->png);
+    png_set_gray_to_rgb(state->png);
+    png_read_update_info(state->png, state->info);
+
+    png_uint_32 width = png_get_image_width(state->png, state->info);
+    png_uint_32 height = png_get_image_height(state->png, state->info);
+    if (width > INT_MAX || height > INT_MAX || png_get_rowbytes(state->png, state->info) != (size_t)width * 3) {
+        return false;
+    }
+    decoder->width = width;
+    decoder->height = height;
+    return true;
+}
+
+static bool png_read_row_rgb(Decoder *decoder, uint8_t *row) {
+    PngState *state = decoder->state;
+    if (setjmp(png_jmpbuf(state->png))) {
+        return false;
+    }
+
+    png_read_row(state->png, row, nullptr);
+    return true;
+}
+
+static void png_close(Decoder *decoder) {
+    PngState *state = decoder->state;
+    if (!state) {
+        return;
+    }
+
+    png_destroy_read_struct(&state->png, &state->info, nullptr);
+    fclose(state->file);
+    free(state);
+}
+
+static const DecoderBackend PNG_BACKEND = {
+    .name = "libpng",
+    .open = png_open,
+    .read_row = png_read_row_rgb,
+    .close = png_close
+};
+
+#endif
+
+// picks a backend from the first bytes of the file, stb_image decodes the rest
+static const DecoderBackend* decoder_backend(FILE *file, DecoderKind kind) {
+    uint8_t magic[8] = {0};
+    size_t length = fread(magic, 1, sizeof(magic), file);
+    rewind(file);
+
+    if (kind == DECODER_STB) {
+        return &STB_BACKEND;
+    }
+    if (length >= 2 && magic[0] == 'P' && magic[1] == '6') {
+        return &PPM_BACKEND;
+    }
+#ifdef QTA_HAVE_JPEG
+    if (length >= 3 && magic[0] == 0xFF && magic[1] == 0xD8 && magic[2] == 0xFF) {
+        return &JPEG_BACKEND;
+    }
+#endif
+#ifdef QTA_HAVE_PNG
+    if (length >= 8 && memcmp(magic, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        return &PNG_BACKEND;
+    }
+#endif
+    return &STB_BACKEND;
+}
+
+static bool decoder_try(Decoder *decoder, const DecoderBackend *backend) {
+    FILE *file = fopen(decoder->path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open image %s\n", decoder->path);
+        return false;
+    }
+
+    decoder->backend = backend;
+    decoder->state = nullptr;
+    decoder->width = 0;
+    decoder->height = 0;
+    decoder->row = 0;
+
+    if (!backend->open(decoder, file)) {
+        backend->close(decoder);
+        decoder->backend = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+bool decoder_open(Decoder *decoder, const char *path, DecoderKind kind) {
+    *decoder = (Decoder) {
+        .path = path
+    };
+
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open image %s\n", path);
+        return false;
+    }
+    const DecoderBackend *backend = decoder_backend(file, kind);
+    fclose(file);
+
+    // a backend may turn down a file it recognized, like an interlaced PNG
+    if (decoder_try(decoder, backend) || (backend != &STB_BACKEND && decoder_try(decoder, &STB_BACKEND))) {
+        return true;
+    }
+
+    fprintf(stderr, "Failed to load image %s\n", path);
+    return false;
+}
+
+bool decoder_read_row(Decoder *decoder, uint8_t *row) {
+    if (decoder->row >= decoder->height || !decoder->backend->read_row(decoder, row)) {
+        fprintf(stderr, "Failed to read image %s: truncated pixel data\n", decoder->path);
+        return false;
+    }
+
+    decoder->row++;
+    return true;
+}
+
+void decoder_close(Decoder *decoder) {
+    if (decoder->backend) {
+        decoder->backend->close(decoder);
+        decoder->backend = nullptr;
+    }
+}
+
+uint8_t* decoder_read_rows(Decoder *decoder, int rows, size_t alignment) {
+    size_t length = (size_t)decoder->width * 3;
+    size_t bytes = length * rows;
+    bytes = (bytes + alignment - 1) / alignment * alignment;
+
+    uint8_t *pixels = aligned_alloc(alignment, bytes);
+    if (!pixels) {
+        fprintf(stderr, "Failed to malloc image %s\n", decoder->path);
+        return nullptr;
+    }
+
+    for (int y = 0; y < rows; y++) {
+        if (!decoder_read_row(decoder, &pixels[(size_t)y * length])) {
+            free(pixels);
+            return nullptr;
+        }
+    }
+
+    return pixels;
+}
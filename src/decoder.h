@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// which decoder image_load goes through
+typedef enum {
+    DECODER_AUTO, // by file signature: PPM, then libjpeg/libpng when built in, else stb_image
+    DECODER_STB, // always stb_image
+} DecoderKind;
+
+struct Decoder;
+
+typedef struct {
+    const char *name;
+    // takes over `file`, positioned at its start, and fills in the size
+    bool (*open)(struct Decoder *decoder, FILE *file);
+    // decodes the next scanline as width * 3 bytes of RGB
+    bool (*read_row)(struct Decoder *decoder, uint8_t *row);
+    void (*close)(struct Decoder *decoder);
+} DecoderBackend;
+
+// An open image handing out 8 bit RGB scanlines top to bottom, whatever the
+// backend. Streaming backends only ever hold a row or so of the image.
+typedef struct Decoder {
+    const DecoderBackend *backend;
+    const char *path;
+    int width;
+    int height;
+    int row;
+    void *state;
+} Decoder;
+
+bool decoder_open(Decoder *decoder, const char *path, DecoderKind kind);
+bool decoder_read_row(Decoder *decoder, uint8_t *row);
+void decoder_close(Decoder *decoder);
+
+// Decodes the next `rows` rows straight into one `alignment` aligned buffer of
+// packed rows, so no second copy is made. Returns nullptr on failure, the buffer
+// is released with free.
+uint8_t* decoder_read_rows(Decoder *decoder, int rows, size_t alignment);
@@ -0,0 +1,273 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "export.h"
+
+// stored deflate blocks hold at most 65535 bytes, each IDAT chunk holds up to
+// PNG_CHUNK_LIMIT bytes of whole scanlines
+#define PNG_MAX_BLOCK 65535
+#define PNG_CHUNK_LIMIT (1u << 24)
+
+static void pixel_to_rgb(uint32_t pixel, uint8_t rgb[static 3]) {
+    rgb[0] = (pixel >> 16) & 0xFF;
+    rgb[1] = (pixel >> 8) & 0xFF;
+    rgb[2] = pixel & 0xFF;
+}
+
+// PNG chunks are written incrementally, the CRC covers the type and the data
+static void png_write(Exporter *exporter, const uint8_t *data, size_t length) {
+    uint32_t crc = exporter->crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = exporter->crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    exporter->crc = crc;
+    exporter->ok = exporter->ok && fwrite(data, 1, length, exporter->file) == length;
+}
+
+static void png_write_u32(Exporter *exporter, uint32_t value) {
+    uint8_t bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+    png_write(exporter, bytes, sizeof(bytes));
+}
+
+static void png_chunk_begin(Exporter *exporter, const char type[static 4], uint32_t length) {
+    png_write_u32(exporter, length);
+    exporter->crc = 0xFFFFFFFF;
+    png_write(exporter, (const uint8_t *)type, 4);
+}
+
+static void png_chunk_end(Exporter *exporter) {
+    png_write_u32(exporter, exporter->crc ^ 0xFFFFFFFF);
+}
+
+// Number of deflate blocks starting in the raw byte range [offset, offset + length)
+static uint64_t png_block_starts(uint64_t offset, uint64_t length) {
+    return (offset + length + PNG_MAX_BLOCK - 1) / PNG_MAX_BLOCK - (offset + PNG_MAX_BLOCK - 1) / PNG_MAX_BLOCK;
+}
+
+// Appends scanline bytes to the zlib stream, opening a stored block every
+// PNG_MAX_BLOCK bytes and marking the one that reaches raw_length as final
+static void png_write_raw(Exporter *exporter, const uint8_t *data, size_t length) {
+    uint32_t a = exporter->adler_a;
+    uint32_t b = exporter->adler_b;
+    for (size_t i = 0; i < length; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    exporter->adler_a = a;
+    exporter->adler_b = b;
+
+    while (length > 0) {
+        uint64_t used = exporter->offset % PNG_MAX_BLOCK;
+        if (used == 0) {
+            uint64_t left = exporter->raw_length - exporter->offset;
+            size_t block = left < PNG_MAX_BLOCK ? left : PNG_MAX_BLOCK;
+            uint8_t block_header[5] = {
+                block == left ? 1 : 0,
+                block & 0xFF, block >> 8,
+                ~block & 0xFF, (~block >> 8) & 0xFF
+            };
+            png_write(exporter, block_header, sizeof(block_header));
+        }
+
+        size_t count = PNG_MAX_BLOCK - used < length ? PNG_MAX_BLOCK - used : length;
+        png_write(exporter, data, count);
+        exporter->offset += count;
+        data += count;
+        length -= count;
+    }
+}
+
+static bool png_begin(Exporter *exporter) {
+    // every scanline is a filter byte (0, none) followed by RGB triplets
+    size_t row_length = 1 + (size_t)exporter->width * 3;
+    if (row_length + 5 * (png_block_starts(0, row_length) + 1) > 0x7FFFFFFF) {
+        fprintf(stderr, "Image too wide for a PNG chunk\n");
+        return false;
+    }
+    exporter->raw_length = (uint64_t)row_length * exporter->height;
+    exporter->offset = 0;
+    exporter->adler_a = 1;
+    exporter->adler_b = 0;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t value = i;
+        for (size_t bit = 0; bit < 8; bit++) {
+            value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+        }
+        exporter->crc_table[i] = value;
+    }
+
+    const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    png_write(exporter, signature, sizeof(signature));
+
+    png_chunk_begin(exporter, "IHDR", 13);
+    png_write_u32(exporter, exporter->width);
+    png_write_u32(exporter, exporter->height);
+    const uint8_t header[5] = {
+        8, // bit depth
+        2, // color type RGB
+        0, // deflate
+        0, // adaptive filtering
+        0  // no interlace
+    };
+    png_write(exporter, header, sizeof(header));
+    png_chunk_end(exporter);
+
+    // the zlib stream is the concatenation of all IDAT chunks, its header and
+    // checksum get chunks of their own
+    png_chunk_begin(exporter, "IDAT", 2);
+    const uint8_t zlib_header[2] = { 0x78, 0x01 };
+    png_write(exporter, zlib_header, sizeof(zlib_header));
+    png_chunk_end(exporter);
+
+    return exporter->ok;
+}
+
+static void png_rows(Exporter *exporter, const uint32_t *pixels, uint32_t rows) {
+    size_t row_length = 1 + (size_t)exporter->width * 3;
+    size_t chunk_rows = PNG_CHUNK_LIMIT / row_length > 0 ? PNG_CHUNK_LIMIT / row_length : 1;
+
+    for (uint32_t y = 0; y < rows && exporter->ok;) {
+        uint32_t count = rows - y < chunk_rows ? rows - y : chunk_rows;
+        uint64_t length = (uint64_t)count * row_length;
+        png_chunk_begin(exporter, "IDAT", length + 5 * png_block_starts(exporter->offset, length));
+
+        for (uint32_t end = y + count; y < end; y++) {
+            const uint32_t *source = &pixels[(size_t)y * exporter->width];
+            exporter->row[0] = 0;
+            for (size_t x = 0; x < exporter->width; x++) {
+                pixel_to_rgb(source[x], &exporter->row[1 + x * 3]);
+            }
+            png_write_raw(exporter, exporter->row, row_length);
+        }
+        png_chunk_end(exporter);
+    }
+}
+
+static void png_end(Exporter *exporter) {
+    png_chunk_begin(exporter, "IDAT", 4);
+    png_write_u32(exporter, (exporter->adler_b << 16) | exporter->adler_a);
+    png_chunk_end(exporter);
+
+    png_chunk_begin(exporter, "IEND", 0);
+    png_chunk_end(exporter);
+}
+
+static void ppm_rows(Exporter *exporter, const uint32_t *pixels, uint32_t rows) {
+    for (size_t y = 0; y < rows && exporter->ok; y++) {
+        const uint32_t *source = &pixels[y * exporter->width];
+        for (size_t x = 0; x < exporter->width; x++) {
+            pixel_to_rgb(source[x], &exporter->row[x * 3]);
+        }
+        exporter->ok = fwrite(exporter->row, 3, exporter->width, exporter->file) == exporter->width;
+    }
+}
+
+static bool has_extension(const char *path, const char *extension) {
+    size_t path_length = strlen(path);
+    size_t extension_length = strlen(extension);
+    if (path_length < extension_length) {
+        return false;
+    }
+
+    const char *tail = &path[path_length - extension_length];
+    for (size_t i = 0; i < extension_length; i++) {
+        char c = tail[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (c != extension[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool export_begin(Exporter *exporter, const char *path, uint32_t width, uint32_t height) {
+    *exporter = (Exporter){
+        .path = path,
+        .width = width,
+        .height = height,
+        .ok = true
+    };
+
+    if (has_extension(path, ".ppm")) {
+        exporter->format = EXPORT_PPM;
+    } else if (has_extension(path, ".png")) {
+        exporter->format = EXPORT_PNG;
+    } else {
+        fprintf(stderr, "Unknown output format %s, expected .png or .ppm\n", path);
+        return false;
+    }
+
+    exporter->row = malloc(1 + (size_t)width * 3);
+    if (!exporter->row) {
+        fprintf(stderr, "Failed to malloc export row\n");
+        return false;
+    }
+
+    exporter->file = fopen(path, "wb");
+    if (!exporter->file) {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        free(exporter->row);
+        exporter->row = nullptr;
+        return false;
+    }
+
+    if (exporter->format == EXPORT_PPM) {
+        exporter->ok = fprintf(exporter->file, "P6\n%u %u\n255\n", width, height) > 0;
+    } else {
+        exporter->ok = png_begin(exporter);
+    }
+    return exporter->ok;
+}
+
+bool export_rows(Exporter *exporter, const uint32_t *pixels, uint32_t rows) {
+    if (!exporter->ok || rows > exporter->height - exporter->rows) {
+        exporter->ok = false;
+        return false;
+    }
+
+    if (exporter->format == EXPORT_PPM) {
+        ppm_rows(exporter, pixels, rows);
+    } else {
+        png_rows(exporter, pixels, rows);
+    }
+    exporter->rows += rows;
+    return exporter->ok;
+}
+
+bool export_end(Exporter *exporter) {
+    if (!exporter->file) {
+        return false;
+    }
+
+    bool ok = exporter->ok && exporter->rows == exporter->height;
+    if (ok && exporter->format == EXPORT_PNG) {
+        png_end(exporter);
+        ok = exporter->ok;
+    }
+    ok = fclose(exporter->file) == 0 && ok;
+    if (!ok) {
+        fprintf(stderr, "Failed to write %s\n", exporter->path);
+    }
+
+    free(exporter->row);
+    exporter->row = nullptr;
+    exporter->file = nullptr;
+    return ok;
+}
+
+bool export_framebuffer(const Framebuffer *framebuffer, const char *path) {
+    Exporter exporter;
+    if (!export_begin(&exporter, path, framebuffer->width, framebuffer->height)) {
+        export_end(&exporter);
+        return false;
+    }
+
+    export_rows(&exporter, framebuffer->data, framebuffer->height);
+    return export_end(&exporter);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "render.h"
+
+typedef enum {
+    EXPORT_PPM,
+    EXPORT_PNG
+} ExportFormat;
+
+// Streams an RGB image to disk a band of rows at a time, the format is picked
+// from the file extension: .ppm (binary P6) or .png (uncompressed deflate, no
+// dependencies). PNG scanlines go out in IDAT chunks of bounded size, so the
+// image size is only limited by the format.
+typedef struct {
+    FILE *file;
+    const char *path;
+    ExportFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t rows;
+    uint8_t *row;
+    bool ok;
+    // PNG state, the CRC of the open chunk and the Adler-32 of the zlib stream
+    uint32_t crc_table[256];
+    uint32_t crc;
+    uint32_t adler_a;
+    uint32_t adler_b;
+    uint64_t offset;
+    uint64_t raw_length;
+} Exporter;
+
+bool export_begin(Exporter *exporter, const char *path, uint32_t width, uint32_t height);
+// Appends rows of width packed 0xRRGGBB pixels.
+bool export_rows(Exporter *exporter, const uint32_t *pixels, uint32_t rows);
+// Finishes and closes the file, fails if fewer than height rows were written.
+bool export_end(Exporter *exporter);
+
+bool export_framebuffer(const Framebuffer *framebuffer, const char *path);
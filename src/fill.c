@@ -0,0 +1,93 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "fill.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// Fills larger than this are streamed past the cache: they would evict most of
+// it anyway, and the renderer only reads them back once when uploading.
+#define FILL_STREAM_BYTES (8u << 20)
+
+static void fill_span_scalar(uint32_t *data, size_t count, uint32_t color) {
+    for (size_t i = 0; i < count; i++) {
+        data[i] = color;
+    }
+}
+
+#ifdef CPU_X86
+
+// Scalar stores up to the first 32 byte boundary, aligned 256 bit stores for the
+// body and scalar stores for the tail of fewer than 8 pixels.
+__attribute__((target("avx2")))
+static inline void fill_span_avx2(uint32_t *data, size_t count, uint32_t color, const bool stream) {
+    const __m256i value = _mm256_set1_epi32(color);
+
+    size_t head = ((32 - ((uintptr_t)data & 31)) & 31) / sizeof(uint32_t);
+    if (head > count) {
+        head = count;
+    }
+    fill_span_scalar(data, head, color);
+
+    size_t i = head;
+    for (; i + 32 <= count; i += 32) {
+        if (stream) {
+            _mm256_stream_si256((__m256i *)&data[i], value);
+            _mm256_stream_si256((__m256i *)&data[i + 8], value);
+            _mm256_stream_si256((__m256i *)&data[i + 16], value);
+            _mm256_stream_si256((__m256i *)&data[i + 24], value);
+        } else {
+            _mm256_store_si256((__m256i *)&data[i], value);
+            _mm256_store_si256((__m256i *)&data[i + 8], value);
+            _mm256_store_si256((__m256i *)&data[i + 16], value);
+            _mm256_store_si256((__m256i *)&data[i + 24], value);
+        }
+    }
+    for (; i + 8 <= count; i += 8) {
+        if (stream) {
+            _mm256_stream_si256((__m256i *)&data[i], value);
+        } else {
+            _mm256_store_si256((__m256i *)&data[i], value);
+        }
+    }
+
+    fill_span_scalar(&data[i], count - i, color);
+}
+
+// the stream flag is a constant in each instantiation, so the branch folds away
+__attribute__((target("avx2")))
+static void fill_rect_avx2(uint32_t *data, size_t stride, size_t width, size_t height, uint32_t color, bool stream) {
+    if (stream) {
+        for (size_t row = 0; row < height; row++) {
+            fill_span_avx2(&data[row * stride], width, color, true);
+        }
+        // streaming stores are weakly ordered, fence before anyone reads the pixels
+        _mm_sfence();
+    } else {
+        for (size_t row = 0; row < height; row++) {
+            fill_span_avx2(&data[row * stride], width, color, false);
+        }
+    }
+}
+
+#endif
+
+void fill_rect(uint32_t *data, size_t stride, size_t width, size_t height, uint32_t color) {
+#ifdef CPU_X86
+    if (cpu_has_avx2()) {
+        bool stream = width * height * sizeof(uint32_t) >= FILL_STREAM_BYTES;
+        fill_rect_avx2(data, stride, width, height, color, stream);
+        return;
+    }
+#endif
+    for (size_t row = 0; row < height; row++) {
+        fill_span_scalar(&data[row * stride], width, color);
+    }
+}
+
+void fill_rows(uint32_t *data, size_t width, size_t rows, uint32_t color) {
+    fill_rect(data, 0, width * rows, 1, color);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fills `height` rows of `width` pixels, `stride` pixels apart, with `color`.
+// Rows are written with 256 bit AVX2 stores when the CPU has them, and boxes too
+// large to stay in cache bypass it with non-temporal stores.
+void fill_rect(uint32_t *data, size_t stride, size_t width, size_t height, uint32_t color);
+
+// Fills `rows` full rows of `width` pixels as one contiguous span, for boxes that
+// span the whole buffer such as a clear.
+void fill_rows(uint32_t *data, size_t width, size_t rows, uint32_t color);
@@ -0,0 +1,204 @@
+#include <stdio.h>
+
+#include "clock.h"
+#include "export.h"
+#include "headless.h"
+#include "image.h"
+#include "linear.h"
+#include "render.h"
+#include "session.h"
+#include "stb_ds.h"
+#include "tiles.h"
+#include "tree.h"
+
+// the pyramid is only read by the scanning statistics, there is no preview
+static ImageConfig headless_image_config(const Options *options) {
+    ImageConfig config = options_image_config(options);
+    config.pyramid = config.pyramid && !config.integral;
+    return config;
+}
+
+static bool headless_run_tree(const Options *options, const Image *image, const char *output, Pool *pool, HeadlessReport *report) {
+    uint64_t start = clock_now_ns();
+
+    Tree tree;
+    if (!tree_init(&tree, image)) {
+        return false;
+    }
+    tree.min_leaf = options->min_leaf;
+
+    bool ok = tree_build(&tree, options->depth);
+    if (!ok) {
+        fprintf(stderr, "Failed to allocate quads for depth %u\n", options->depth);
+    }
+
+    PackedHeap heap;
+    packed_heap_init(&heap, options->score);
+
+    size_t splits = 0;
+    if (ok && tree_push_leaves(&tree, &heap)) {
+        bool out_of_memory;
+        splits = tree_refine(&tree, &heap, options->splits, options->error, &out_of_memory);
+        if (out_of_memory) {
+            fprintf(stderr, "Failed to allocate quads after %zu splits\n", splits);
+            ok = false;
+        }
+    } else if (ok) {
+        fprintf(stderr, "Failed to allocate heap\n");
+        ok = false;
+    }
+    packed_heap_deinit(&heap);
+
+    uint64_t built = clock_now_ns();
+
+    Framebuffer framebuffer;
+    ok = ok && framebuffer_init(&framebuffer, image->width + PADDING, image->height + PADDING);
+    if (ok) {
+        render_tree(&framebuffer, &tree, pool);
+        ok = export_framebuffer(&framebuffer, output);
+        framebuffer_deinit(&framebuffer);
+    }
+
+    if (report) {
+        *report = (HeadlessReport) {
+            .refine = built - start,
+            .write = clock_now_ns() - built,
+            .splits = splits
+        };
+    }
+
+    tree_deinit(&tree);
+    return ok;
+}
+
+static bool headless_run_linear(const Options *options, const Image *image, const char *output, HeadlessReport *report) {
+    uint64_t start = clock_now_ns();
+
+    LinearTree tree;
+    if (!linear_init(&tree, image)) {
+        return false;
+    }
+    tree.min_leaf = options->min_leaf;
+
+    bool ok = linear_build(&tree, options->depth);
+
+    PackedHeap heap;
+    packed_heap_init(&heap, options->score);
+
+    if (ok && linear_push_leaves(&tree, &heap)) {
+        bool out_of_memory;
+        size_t splits = linear_refine(&tree, &heap, options->splits, options->error, &out_of_memory);
+        if (out_of_memory) {
+            fprintf(stderr, "Failed to allocate quads after %zu splits\n", splits);
+            ok = false;
+        }
+    } else if (ok) {
+        fprintf(stderr, "Failed to allocate heap\n");
+        ok = false;
+    }
+    packed_heap_deinit(&heap);
+
+    uint64_t built = clock_now_ns();
+
+    Framebuffer framebuffer;
+    ok = ok && framebuffer_init(&framebuffer, image->width + PADDING, image->height + PADDING);
+    if (ok) {
+        render_linear(&framebuffer, &tree);
+        ok = export_framebuffer(&framebuffer, output);
+        framebuffer_deinit(&framebuffer);
+    }
+
+    if (report) {
+        *report = (HeadlessReport) {
+            .refine = built - start,
+            .write = clock_now_ns() - built,
+            .splits = (hmlen(tree.nodes) - 1) / 4
+        };
+    }
+
+    linear_deinit(&tree);
+    return ok;
+}
+
+static bool headless_run_tiles(const Options *options, const char *input, const char *output, HeadlessReport *report) {
+    uint64_t start = clock_now_ns();
+
+    TileConfig config = {
+        .size = options->tile,
+        .image = headless_image_config(options),
+        .session = options_session_config(options)
+    };
+    TileReport tiles;
+    bool ok = tiles_run(input, output, &config, options->splits, options->error, &tiles);
+
+    if (report) {
+        *report = (HeadlessReport) {
+            .load = tiles.load,
+            .refine = clock_now_ns() - start - tiles.load - tiles.write,
+            .write = tiles.write,
+            .splits = tiles.splits
+        };
+    }
+
+    return ok;
+}
+
+bool headless_run(const Options *options, const char *input, const char *output, Pool *pool, HeadlessReport *report) {
+    // tiles decode the image themselves, a band at a time
+    if (options->tile > 0) {
+        return headless_run_tiles(options, input, output, report);
+    }
+
+    uint64_t start = clock_now_ns();
+
+    ImageConfig image_config = headless_image_config(options);
+    Image image;
+    if (!image_load(&image, input, &image_config)) {
+        return false;
+    }
+
+    uint64_t loaded = clock_now_ns();
+
+    if (options->backend != BACKEND_POINTER) {
+        bool ok = options->backend == BACKEND_SOA
+            ? headless_run_tree(options, &image, output, pool, report)
+            : headless_run_linear(options, &image, output, report);
+        if (report) {
+            report->load = loaded - start;
+        }
+        image_free(&image);
+        return ok;
+    }
+
+    SessionConfig config = options_session_config(options);
+    Session session;
+    if (!session_init(&session, &image, &config)) {
+        image_free(&image);
+        return false;
+    }
+    session_refine(&session, options->splits, options->error);
+
+    uint64_t refined = clock_now_ns();
+
+    Framebuffer framebuffer;
+    bool ok = !session.out_of_memory && framebuffer_init(&framebuffer, image.width + PADDING, image.height + PADDING);
+    if (ok) {
+        render_quads(&framebuffer, &session.root, pool);
+        ok = export_framebuffer(&framebuffer, output);
+        framebuffer_deinit(&framebuffer);
+    }
+
+    if (report) {
+        *report = (HeadlessReport) {
+            .load = loaded - start,
+            .refine = refined - loaded,
+            .write = clock_now_ns() - refined,
+            .splits = session.splits
+        };
+    }
+
+    session_deinit(&session);
+    image_free(&image);
+
+    return ok;
+}
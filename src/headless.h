@@ -0,0 +1,21 @@
+#pragma once
+
+#include "options.h"
+#include "pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// time spent in each phase of a headless run, in nanoseconds
+typedef struct {
+    uint64_t load;
+    uint64_t refine;
+    uint64_t write;
+    size_t splits;
+} HeadlessReport;
+
+// Loads `input`, refines it according to `options` and writes the rendered result
+// to `output`. Never touches SDL, so it runs on machines without a display.
+// `pool` rasterizes the result in parallel and `report` is optional, both may be
+// nullptr.
+bool headless_run(const Options *options, const char *input, const char *output, Pool *pool, HeadlessReport *report);
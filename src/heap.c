@@ -1,75 +1,365 @@
-#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "heap.h"
-#include "stb_ds.h"
+#include "score.h"
 
-static void heap_swap(Heap *heap, size_t a, size_t b) {
-    HeapNode tmp = heap->data[a];
-    heap->data[a] = heap->data[b];
-    heap->data[b] = tmp;
+#define HEAP_ALIGNMENT 64
+
+static size_t heap_arity(const Heap *heap) {
+    return heap->kind == HEAP_QUATERNARY ? 4 : 2;
 }
 
-static void heapify_up(Heap *heap, size_t index) {
-    if (index == 0) {
-        return;
+// Both sifts carry the moving node in a local and shift the nodes it passes by
+// one slot, so it is written to the array once at its final position. They are
+// inlined with a constant arity so each kind gets its own unrolled loop.
+static inline void heapify_up(Heap *heap, size_t index, const size_t arity) {
+    HeapNode node = heap->data[index];
+
+    while (index > 0) {
+        size_t parent = (index - 1) / arity;
+        if (heap->data[parent].score <= node.score) {
+            break;
+        }
+
+        heap->data[index] = heap->data[parent];
+        index = parent;
     }
 
-    size_t parent = (index - 1) / 2;
-    if (heap->data[parent].score > heap->data[index].score) {
-        heap_swap(heap, index, parent);
-        heapify_up(heap, parent);
+    heap->data[index] = node;
+}
+
+static inline void heapify_down(Heap *heap, size_t index, const size_t arity) {
+    HeapNode node = heap->data[index];
+
+    while (true) {
+        size_t first = index * arity + 1;
+        if (first >= heap->length) {
+            break;
+        }
+
+        size_t last = first + arity < heap->length ? first + arity : heap->length;
+        size_t smallest = first;
+        for (size_t child = first + 1; child < last; child++) {
+            if (heap->data[child].score < heap->data[smallest].score) {
+                smallest = child;
+            }
+        }
+
+        if (heap->data[smallest].score >= node.score) {
+            break;
+        }
+
+        heap->data[index] = heap->data[smallest];
+        index = smallest;
     }
+
+    heap->data[index] = node;
 }
 
-static void heapify_down(Heap *heap, size_t index) {
-    size_t left = index * 2 + 1;
-    size_t right = index * 2 + 2;
+static void heap_sift_up(Heap *heap, size_t index) {
+    if (heap->kind == HEAP_QUATERNARY) {
+        heapify_up(heap, index, 4);
+    } else {
+        heapify_up(heap, index, 2);
+    }
+}
 
-    if (left >= heap->length) {
-        return;
+static void heap_sift_down(Heap *heap, size_t index) {
+    if (heap->kind == HEAP_QUATERNARY) {
+        heapify_down(heap, index, 4);
+    } else {
+        heapify_down(heap, index, 2);
     }
+}
+
+static bool heap_reserve(Heap *heap, size_t length) {
+    if (length <= heap->capacity) {
+        return true;
+    }
+
+    size_t capacity = heap->capacity ? heap->capacity * 2 : 64;
+    while (capacity < length) {
+        capacity *= 2;
+    }
+
+    size_t offset = heap_arity(heap) - 1;
+    size_t bytes = (capacity + offset) * sizeof(HeapNode);
+    bytes = (bytes + HEAP_ALIGNMENT - 1) / HEAP_ALIGNMENT * HEAP_ALIGNMENT;
+
+    HeapNode *storage = aligned_alloc(HEAP_ALIGNMENT, bytes);
+    if (!storage) {
+        return false;
+    }
+
+    if (heap->length > 0) {
+        memcpy(&storage[offset], heap->data, heap->length * sizeof(HeapNode));
+    }
+    free(heap->storage);
+
+    heap->storage = storage;
+    heap->data = &storage[offset];
+    heap->capacity = capacity;
+    return true;
+}
+
+// Scores are negated priorities. The bits of a float >= 1 grow monotonically and
+// roughly like 2^23 * log2, so the bits of 1 + priority give a cheap log scale:
+// 32 octaves spread over all buckets.
+static size_t heap_bucket_index(const Heap *heap, float score) {
+    float priority = score < 0 ? -score : 0;
+    float value = 1 + priority;
 
-    size_t smallest = index;
-    if (heap->data[left].score < heap->data[index].score) {
-        smallest = left;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint64_t octaves = bits - 0x3F800000u;
+    size_t index = (octaves * (heap->bucket_count - 1)) >> (23 + 5);
+    return index < heap->bucket_count ? index : heap->bucket_count - 1;
+}
+
+static bool heap_bucket_push(Heap *heap, HeapNode node) {
+    size_t index = heap_bucket_index(heap, node.score);
+    HeapBucket *bucket = &heap->buckets[index];
+
+    if (bucket->length == bucket->capacity) {
+        size_t capacity = bucket->capacity ? bucket->capacity * 2 : 16;
+        HeapNode *nodes = realloc(bucket->nodes, capacity * sizeof(HeapNode));
+        if (!nodes) {
+            return false;
+        }
+        bucket->nodes = nodes;
+        bucket->capacity = capacity;
     }
 
-    if (right < heap->length && heap->data[right].score < heap->data[smallest].score) {
-        smallest = right;
+    bucket->nodes[bucket->length++] = node;
+    heap->length++;
+    if (index > heap->top) {
+        heap->top = index;
     }
 
-    if (smallest != index) {
-        heap_swap(heap, index, smallest);
-        heapify_down(heap, smallest);
+    return true;
+}
+
+// the top only moves down while scanning past buckets emptied by earlier pops
+static HeapBucket* heap_bucket_top(Heap *heap) {
+    while (heap->buckets[heap->top].length == 0) {
+        heap->top--;
     }
+
+    return &heap->buckets[heap->top];
 }
 
-void heap_init(Heap *heap) {
+static Quad* heap_bucket_pop(Heap *heap) {
+    HeapBucket *bucket = heap_bucket_top(heap);
+    heap->length--;
+    return bucket->nodes[--bucket->length].quad;
+}
+
+void heap_init(Heap *heap, HeapKind kind, ScoreKind score) {
     heap->data = nullptr;
     heap->length = 0;
+    heap->capacity = 0;
+    heap->storage = nullptr;
+    heap->kind = kind;
+    heap->score = score;
+    heap->buckets = nullptr;
+    heap->bucket_count = 0;
+    heap->top = 0;
 }
 
-void heap_push(Heap *heap, Quad *quad) {
-    Box box = quad->boundary.box;
-    bool is_leaf = (box.right - box.left <= 4) || (box.bottom - box.top <= 4);
+bool heap_init_buckets(Heap *heap, size_t bucket_count, ScoreKind score) {
+    heap_init(heap, HEAP_BUCKET, score);
 
-    float score = -quad->average_color.error * pow(quad->boundary.area, 0.25) + (is_leaf ? 1000000 : 0);
-    HeapNode node = (HeapNode) {
-        .quad = quad,
-        .score = score
-    };
+    heap->buckets = calloc(bucket_count, sizeof(HeapBucket));
+    if (!heap->buckets) {
+        return false;
+    }
+    heap->bucket_count = bucket_count;
 
-    arrpush(heap->data, node);
-    heap->length += 1;
-    heapify_up(heap, heap->length - 1);
+    return true;
+}
+
+void heap_deinit(Heap *heap) {
+    for (size_t i = 0; i < heap->bucket_count; i++) {
+        free(heap->buckets[i].nodes);
+    }
+    free(heap->buckets);
+    free(heap->storage);
+    heap_init(heap, heap->kind, heap->score);
+}
+
+bool heap_push(Heap *heap, Quad *quad) {
+    return heap_push_many(heap, &quad, 1);
+}
+
+// Inlined with a constant score kind like the sifts with their arity, so the
+// scoring switch is resolved once per batch instead of once per node.
+static inline bool heap_push_scored(Heap *heap, Quad *const quads[], size_t count, const ScoreKind score) {
+    if (heap->kind == HEAP_BUCKET) {
+        for (size_t i = 0; i < count; i++) {
+            HeapNode node = (HeapNode) {
+                .quad = quads[i],
+                .score = score_quad(score, quads[i]->average_color.error, quads[i]->average_color.color, &quads[i]->boundary.box)
+            };
+            if (!heap_bucket_push(heap, node)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // grow once for the whole batch, then sift every new node into place
+    if (!heap_reserve(heap, heap->length + count)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        heap->data[heap->length] = (HeapNode) {
+            .quad = quads[i],
+            .score = score_quad(score, quads[i]->average_color.error, quads[i]->average_color.color, &quads[i]->boundary.box)
+        };
+
+        heap->length += 1;
+        heap_sift_up(heap, heap->length - 1);
+    }
+
+    return true;
+}
+
+bool heap_push_many(Heap *heap, Quad *const quads[], size_t count) {
+    switch (heap->score) {
+        case SCORE_ERROR:
+            return heap_push_scored(heap, quads, count, SCORE_ERROR);
+        case SCORE_AREA:
+            return heap_push_scored(heap, quads, count, SCORE_AREA);
+        case SCORE_SQRT_AREA:
+            return heap_push_scored(heap, quads, count, SCORE_SQRT_AREA);
+        case SCORE_PERCEPTUAL:
+            return heap_push_scored(heap, quads, count, SCORE_PERCEPTUAL);
+        case SCORE_ROOT4_AREA:
+        default:
+            return heap_push_scored(heap, quads, count, SCORE_ROOT4_AREA);
+    }
 }
 
 Quad* heap_pop(Heap *heap) {
-    heap_swap(heap, 0, heap->length - 1);
+    if (heap->kind == HEAP_BUCKET) {
+        return heap_bucket_pop(heap);
+    }
+
+    Quad *quad = heap->data[0].quad;
+
     heap->length--;
-    HeapNode node = arrpop(heap->data);
+    if (heap->length > 0) {
+        heap->data[0] = heap->data[heap->length];
+        heap_sift_down(heap, 0);
+    }
+
+    return quad;
+}
+
+Quad* heap_top(Heap *heap) {
+    if (heap->kind == HEAP_BUCKET) {
+        HeapBucket *bucket = heap_bucket_top(heap);
+        return bucket->nodes[bucket->length - 1].quad;
+    }
+
+    return heap->data[0].quad;
+}
+
+float heap_top_score(Heap *heap) {
+    if (heap->kind == HEAP_BUCKET) {
+        HeapBucket *bucket = heap_bucket_top(heap);
+        return bucket->nodes[bucket->length - 1].score;
+    }
+
+    return heap->data[0].score;
+}
+
+static void packed_heapify_up(PackedHeap *heap, size_t index) {
+    PackedNode node = heap->data[index];
+
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (heap->data[parent].score <= node.score) {
+            break;
+        }
+
+        heap->data[index] = heap->data[parent];
+        index = parent;
+    }
+
+    heap->data[index] = node;
+}
 
-    heapify_down(heap, 0);
+static void packed_heapify_down(PackedHeap *heap, size_t index) {
+    PackedNode node = heap->data[index];
+
+    while (true) {
+        size_t smallest = index * 2 + 1;
+        if (smallest >= heap->length) {
+            break;
+        }
+
+        size_t right = smallest + 1;
+        if (right < heap->length && heap->data[right].score < heap->data[smallest].score) {
+            smallest = right;
+        }
+
+        if (heap->data[smallest].score >= node.score) {
+            break;
+        }
+
+        heap->data[index] = heap->data[smallest];
+        index = smallest;
+    }
+
+    heap->data[index] = node;
+}
+
+void packed_heap_init(PackedHeap *heap, ScoreKind score) {
+    heap->data = nullptr;
+    heap->length = 0;
+    heap->capacity = 0;
+    heap->score = score;
+}
+
+void packed_heap_deinit(PackedHeap *heap) {
+    free(heap->data);
+    packed_heap_init(heap, heap->score);
+}
+
+bool packed_heap_push(PackedHeap *heap, uint32_t index, float score) {
+    if (heap->length == heap->capacity) {
+        size_t capacity = heap->capacity ? heap->capacity * 2 : 64;
+        PackedNode *data = realloc(heap->data, capacity * sizeof(PackedNode));
+        if (!data) {
+            return false;
+        }
+        heap->data = data;
+        heap->capacity = capacity;
+    }
+
+    heap->data[heap->length] = (PackedNode) {
+        .score = score,
+        .index = index
+    };
+    heap->length += 1;
+    packed_heapify_up(heap, heap->length - 1);
+
+    return true;
+}
+
+uint32_t packed_heap_pop(PackedHeap *heap) {
+    uint32_t index = heap->data[0].index;
+
+    heap->length--;
+    if (heap->length > 0) {
+        heap->data[0] = heap->data[heap->length];
+        packed_heapify_down(heap, 0);
+    }
 
-    return node.quad;
+    return index;
 }
@@ -1,19 +1,78 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "quad.h"
+#include "score.h"
 
 typedef struct {
     Quad *quad;
     float score;
 } HeapNode;
 
+typedef enum {
+    HEAP_BINARY,
+    // 4-ary heap, shallower than the binary one and the four children of a slot
+    // share one 64 byte cache line, which suits the pop one / push four pattern
+    HEAP_QUATERNARY,
+    // Bucket queue over the quantized log of the priority: O(1) push, amortized
+    // O(1) pop of a node from the highest non-empty bucket. Order inside a bucket
+    // is arbitrary, so the refinement order is only approximate.
+    HEAP_BUCKET,
+} HeapKind;
+
+typedef struct {
+    HeapNode *nodes;
+    size_t length;
+    size_t capacity;
+} HeapBucket;
+
 typedef struct {
+    // node 0 sits (arity - 1) slots into `storage`, so every group of siblings
+    // starts on a cache line boundary
     HeapNode *data;
     size_t length;
+    size_t capacity;
+    HeapNode *storage;
+    HeapKind kind;
+    ScoreKind score;
+
+    // HEAP_BUCKET only, `length` still counts all nodes
+    HeapBucket *buckets;
+    size_t bucket_count;
+    size_t top;
 } Heap;
 
-void heap_init(Heap *heap);
-void heap_push(Heap *heap, Quad *quad);
+void heap_init(Heap *heap, HeapKind kind, ScoreKind score);
+// initializes a HEAP_BUCKET queue, more buckets give a finer ordering
+bool heap_init_buckets(Heap *heap, size_t bucket_count, ScoreKind score);
+void heap_deinit(Heap *heap);
+// both return false when the heap can not grow, nodes that did fit stay queued
+bool heap_push(Heap *heap, Quad *quad);
+// pushes a batch, such as the four children of one split, growing the heap once
+bool heap_push_many(Heap *heap, Quad *const quads[], size_t count);
 Quad* heap_pop(Heap *heap);
+// the node heap_pop would return next and its score, the heap must not be empty
+Quad* heap_top(Heap *heap);
+float heap_top_score(Heap *heap);
+
+// Binary heap of 8 byte nodes: a score plus the 32 bit index of a node in an
+// index based Tree, half the size of a HeapNode with its pointer and padding.
+typedef struct {
+    float score;
+    uint32_t index;
+} PackedNode;
+
+typedef struct {
+    PackedNode *data;
+    size_t length;
+    size_t capacity;
+    // the scoring the owner computes pushed scores with
+    ScoreKind score;
+} PackedHeap;
+
+void packed_heap_init(PackedHeap *heap, ScoreKind score);
+void packed_heap_deinit(PackedHeap *heap);
+bool packed_heap_push(PackedHeap *heap, uint32_t index, float score);
+uint32_t packed_heap_pop(PackedHeap *heap);
@@ -0,0 +1,130 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "histogram.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+static Moments histogram_moments_scalar(const uint32_t histogram[static 768]) {
+    Moments moments = {0};
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        const uint32_t *bins = &histogram[channel * 256];
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t sum_sq = 0;
+
+        for (uint64_t i = 0; i < 256; i++) {
+            count += bins[i];
+            sum += bins[i] * i;
+            sum_sq += bins[i] * i * i;
+        }
+
+        moments.count = count;
+        moments.sum[channel] = sum;
+        moments.sum_sq[channel] = sum_sq;
+    }
+
+    return moments;
+}
+
+#ifdef CPU_X86
+
+// 32 bit lanes are widened by multiplying the even and odd lanes separately with
+// mul_epu32, which yields full 64 bit products of the low halves.
+__attribute__((target("avx2")))
+static Moments histogram_moments_avx2(const uint32_t histogram[static 768]) {
+    Moments moments = {0};
+    const __m256i low_mask = _mm256_set1_epi64x(0xFFFFFFFF);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        const uint32_t *bins = &histogram[channel * 256];
+        __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        __m256i count = _mm256_setzero_si256();
+        __m256i sum = _mm256_setzero_si256();
+        __m256i sum_sq = _mm256_setzero_si256();
+
+        for (size_t i = 0; i < 256; i += 8) {
+            __m256i value = _mm256_loadu_si256((const __m256i *)&bins[i]);
+            __m256i value_odd = _mm256_srli_epi64(value, 32);
+            __m256i index_sq = _mm256_mullo_epi32(index, index);
+
+            count = _mm256_add_epi64(count, _mm256_add_epi64(_mm256_and_si256(value, low_mask), value_odd));
+            sum = _mm256_add_epi64(sum, _mm256_mul_epu32(value, index));
+            sum = _mm256_add_epi64(sum, _mm256_mul_epu32(value_odd, _mm256_srli_epi64(index, 32)));
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_mul_epu32(value, index_sq));
+            sum_sq = _mm256_add_epi64(sum_sq, _mm256_mul_epu32(value_odd, _mm256_srli_epi64(index_sq, 32)));
+
+            index = _mm256_add_epi32(index, step);
+        }
+
+        uint64_t lanes[3][4];
+        _mm256_storeu_si256((__m256i *)lanes[0], count);
+        _mm256_storeu_si256((__m256i *)lanes[1], sum);
+        _mm256_storeu_si256((__m256i *)lanes[2], sum_sq);
+
+        moments.count = lanes[0][0] + lanes[0][1] + lanes[0][2] + lanes[0][3];
+        moments.sum[channel] = lanes[1][0] + lanes[1][1] + lanes[1][2] + lanes[1][3];
+        moments.sum_sq[channel] = lanes[2][0] + lanes[2][1] + lanes[2][2] + lanes[2][3];
+    }
+
+    return moments;
+}
+
+__attribute__((target("sse4.1")))
+static Moments histogram_moments_sse41(const uint32_t histogram[static 768]) {
+    Moments moments = {0};
+    const __m128i low_mask = _mm_set1_epi64x(0xFFFFFFFF);
+    const __m128i step = _mm_set1_epi32(4);
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        const uint32_t *bins = &histogram[channel * 256];
+        __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+        __m128i count = _mm_setzero_si128();
+        __m128i sum = _mm_setzero_si128();
+        __m128i sum_sq = _mm_setzero_si128();
+
+        for (size_t i = 0; i < 256; i += 4) {
+            __m128i value = _mm_loadu_si128((const __m128i *)&bins[i]);
+            __m128i value_odd = _mm_srli_epi64(value, 32);
+            __m128i index_sq = _mm_mullo_epi32(index, index);
+
+            count = _mm_add_epi64(count, _mm_add_epi64(_mm_and_si128(value, low_mask), value_odd));
+            sum = _mm_add_epi64(sum, _mm_mul_epu32(value, index));
+            sum = _mm_add_epi64(sum, _mm_mul_epu32(value_odd, _mm_srli_epi64(index, 32)));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_mul_epu32(value, index_sq));
+            sum_sq = _mm_add_epi64(sum_sq, _mm_mul_epu32(value_odd, _mm_srli_epi64(index_sq, 32)));
+
+            index = _mm_add_epi32(index, step);
+        }
+
+        uint64_t lanes[3][2];
+        _mm_storeu_si128((__m128i *)lanes[0], count);
+        _mm_storeu_si128((__m128i *)lanes[1], sum);
+        _mm_storeu_si128((__m128i *)lanes[2], sum_sq);
+
+        moments.count = lanes[0][0] + lanes[0][1];
+        moments.sum[channel] = lanes[1][0] + lanes[1][1];
+        moments.sum_sq[channel] = lanes[2][0] + lanes[2][1];
+    }
+
+    return moments;
+}
+
+#endif
+
+Moments histogram_moments(const uint32_t histogram[static 768]) {
+#ifdef CPU_X86
+    if (cpu_has_avx2()) {
+        return histogram_moments_avx2(histogram);
+    }
+    if (cpu_has_sse41()) {
+        return histogram_moments_sse41(histogram);
+    }
+#endif
+    return histogram_moments_scalar(histogram);
+}
@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cpu.h"
+#include "decoder.h"
+#include "image.h"
+#include "integral.h"
+#include "pyramid.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+// rows are handed to the vector kernels, start them on a cache line
+#define IMAGE_ALIGNMENT 64
+
+// Feeds the decoder's scanlines to the integral one at a time, so with a
+// streaming backend only a single row of pixels is ever held next to the tables.
+static bool image_load_integral(Image *image, Decoder *decoder) {
+    image->integral = calloc(1, sizeof(IntegralImage));
+    if (!image->integral) {
+        fprintf(stderr, "Failed to malloc integral image\n");
+        return false;
+    }
+
+    if (!integral_alloc(image->integral, image->width, image->height)) {
+        return false;
+    }
+
+    uint8_t *row = malloc((size_t)image->width * 3);
+    if (!row) {
+        fprintf(stderr, "Failed to malloc image row\n");
+        return false;
+    }
+
+    bool ok = true;
+    for (int y = 0; y < image->height && ok; y++) {
+        ok = decoder_read_row(decoder, row);
+        if (ok) {
+            integral_push_row(image->integral, row);
+        }
+    }
+
+    free(row);
+    return ok;
+}
+
+static void image_convert_row_rgbx_scalar(const uint8_t *row, uint8_t *out, size_t first, size_t count) {
+    for (size_t x = first; x < count; x++) {
+        out[x * 4 + 0] = row[x * 3 + 0];
+        out[x * 4 + 1] = row[x * 3 + 1];
+        out[x * 4 + 2] = row[x * 3 + 2];
+        out[x * 4 + 3] = 0;
+    }
+}
+
+static void image_convert_row_planar_scalar(const uint8_t *row, uint8_t *out, size_t plane, size_t first, size_t count) {
+    for (size_t x = first; x < count; x++) {
+        out[x] = row[x * 3 + 0];
+        out[plane + x] = row[x * 3 + 1];
+        out[plane * 2 + x] = row[x * 3 + 2];
+    }
+}
+
+#ifdef CPU_X86
+
+// Both conversions read 16 pixels as four 16 byte loads, 12 bytes apart, each
+// holding four whole pixels. The last load reaches 4 bytes past the 48 of the
+// group, so the vector loop stops while two more pixels are left in the row.
+#define IMAGE_CONVERT_OVERREAD 2
+
+__attribute__((target("sse4.1")))
+static void image_convert_row_rgbx_sse41(const uint8_t *row, uint8_t *out, size_t count) {
+    const __m128i pad = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+    size_t x = 0;
+    for (; x + 16 + IMAGE_CONVERT_OVERREAD <= count; x += 16) {
+        for (size_t i = 0; i < 4; i++) {
+            __m128i pixels = _mm_loadu_si128((const __m128i *)&row[(x + i * 4) * 3]);
+            _mm_storeu_si128((__m128i *)&out[(x + i * 4) * 4], _mm_shuffle_epi8(pixels, pad));
+        }
+    }
+
+    image_convert_row_rgbx_scalar(row, out, x, count);
+}
+
+// pshufb groups the channels of each four pixels into 32 bit lanes, then the
+// same unpack transpose as the RGBX moments kernel yields one register per plane
+__attribute__((target("sse4.1")))
+static void image_convert_row_planar_sse41(const uint8_t *row, uint8_t *out, size_t plane, size_t count) {
+    const __m128i group = _mm_setr_epi8(0, 3, 6, 9, 1, 4, 7, 10, 2, 5, 8, 11, -1, -1, -1, -1);
+
+    size_t x = 0;
+    for (; x + 16 + IMAGE_CONVERT_OVERREAD <= count; x += 16) {
+        __m128i a = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&row[x * 3]), group);
+        __m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&row[x * 3 + 12]), group);
+        __m128i c = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&row[x * 3 + 24]), group);
+        __m128i d = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)&row[x * 3 + 36]), group);
+
+        __m128i red_green_ab = _mm_unpacklo_epi32(a, b);
+        __m128i blue_ab = _mm_unpackhi_epi32(a, b);
+        __m128i red_green_cd = _mm_unpacklo_epi32(c, d);
+        __m128i blue_cd = _mm_unpackhi_epi32(c, d);
+
+        _mm_storeu_si128((__m128i *)&out[x], _mm_unpacklo_epi64(red_green_ab, red_green_cd));
+        _mm_storeu_si128((__m128i *)&out[plane + x], _mm_unpackhi_epi64(red_green_ab, red_green_cd));
+        _mm_storeu_si128((__m128i *)&out[plane * 2 + x], _mm_unpacklo_epi64(blue_ab, blue_cd));
+    }
+
+    image_convert_row_planar_scalar(row, out, plane, x, count);
+}
+
+#endif
+
+static void image_convert_row(const uint8_t *row, uint8_t *out, const Image *image) {
+#ifdef CPU_X86
+    if (cpu_has_sse41()) {
+        if (image->layout == LAYOUT_RGBX) {
+            image_convert_row_rgbx_sse41(row, out, image->width);
+        } else {
+            image_convert_row_planar_sse41(row, out, image->plane, image->width);
+        }
+        return;
+    }
+#endif
+
+    if (image->layout == LAYOUT_RGBX) {
+        image_convert_row_rgbx_scalar(row, out, 0, image->width);
+    } else {
+        image_convert_row_planar_scalar(row, out, image->plane, 0, image->width);
+    }
+}
+
+// Decodes into the requested layout row by row, so the packed RGB image never
+// exists next to the converted one.
+static bool image_load_pixels(Image *image, Decoder *decoder, PixelLayout layout) {
+    image->layout = layout;
+
+    if (layout == LAYOUT_RGB) {
+        image->stride = (size_t)image->width * 3;
+        image->data = decoder_read_rows(decoder, image->height, IMAGE_ALIGNMENT);
+        return image->data != nullptr;
+    }
+
+    size_t row_bytes = layout == LAYOUT_RGBX ? (size_t)image->width * 4 : (size_t)image->width;
+    image->stride = (row_bytes + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+    image->plane = image->stride * image->height;
+
+    size_t planes = layout == LAYOUT_PLANAR ? 3 : 1;
+    image->data = aligned_alloc(IMAGE_ALIGNMENT, image->plane * planes);
+    uint8_t *row = malloc((size_t)image->width * 3);
+    if (!image->data || !row) {
+        fprintf(stderr, "Failed to malloc image\n");
+        free(row);
+        return false;
+    }
+
+    bool ok = true;
+    for (int y = 0; y < image->height && ok; y++) {
+        ok = decoder_read_row(decoder, row);
+        if (!ok) {
+            break;
+        }
+
+        image_convert_row(row, &image->data[(size_t)y * image->stride], image);
+    }
+
+    free(row);
+    return ok;
+}
+
+static bool image_load_pyramid(Image *image) {
+    Pyramid *pyramid = calloc(1, sizeof(Pyramid));
+    if (!pyramid) {
+        fprintf(stderr, "Failed to malloc image pyramid\n");
+        return false;
+    }
+
+    // built before it is attached, so the cells come from the tables or the pixels
+    if (!pyramid_init(pyramid, image)) {
+        free(pyramid);
+        return false;
+    }
+
+    image->pyramid = pyramid;
+    return true;
+}
+
+bool image_read(Image *image, Decoder *decoder, int rows, const ImageConfig *config) {
+    *image = (Image) {
+        .width = decoder->width,
+        .height = rows,
+        .stats = config->stats
+    };
+
+    // the tables answer every statistics query, the pixels are not kept
+    bool ok;
+    if (config->integral) {
+        ok = image_load_integral(image, decoder);
+    } else {
+        ok = image_load_pixels(image, decoder, config->layout);
+    }
+
+    if (ok && config->pyramid) {
+        ok = image_load_pyramid(image);
+    }
+    if (!ok) {
+        image_free(image);
+    }
+    return ok;
+}
+
+bool image_load(Image *image, const char *path, const ImageConfig *config) {
+    Decoder decoder;
+    if (!decoder_open(&decoder, path, config->decoder)) {
+        *image = (Image) {0};
+        return false;
+    }
+
+    bool ok = image_read(image, &decoder, decoder.height, config);
+    decoder_close(&decoder);
+    return ok;
+}
+
+void image_free(Image *image) {
+    if (image->pyramid) {
+        pyramid_deinit(image->pyramid);
+        free(image->pyramid);
+        image->pyramid = nullptr;
+    }
+
+    if (image->integral) {
+        integral_deinit(image->integral);
+        free(image->integral);
+        image->integral = nullptr;
+    }
+
+    free(image->data);
+    image->data = nullptr;
+}
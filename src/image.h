@@ -0,0 +1,26 @@
+#pragma once
+
+#include "decoder.h"
+#include "quad.h"
+
+typedef struct {
+    StatsMode stats;
+    // summed-area tables instead of the pixels
+    bool integral;
+    DecoderKind decoder;
+    // pixel layout without tables
+    PixelLayout layout;
+    // build the cell moments mip chain
+    bool pyramid;
+} ImageConfig;
+
+// Decodes an image as 8 bit RGB and prepares it for the chosen statistics mode.
+// When `integral` is set the summed-area tables are built from the decoder's
+// scanlines and the pixels are never kept, otherwise they are decoded into one
+// cache line aligned buffer in `layout`. With `pyramid` the cell moments mip
+// chain is built on top of whichever of the two was loaded.
+bool image_load(Image *image, const char *path, const ImageConfig *config);
+// Same for just the next `rows` scanlines of an open decoder, which become an
+// image of their own, so tall images can be processed a band at a time.
+bool image_read(Image *image, Decoder *decoder, int rows, const ImageConfig *config);
+void image_free(Image *image);
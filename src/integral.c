@@ -0,0 +1,76 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "integral.h"
+
+static size_t integral_index(const IntegralImage *integral, uint32_t row, uint32_t column) {
+    return ((size_t)row * (integral->width + 1) + column) * 3;
+}
+
+bool integral_alloc(IntegralImage *integral, uint32_t width, uint32_t height) {
+    integral->width = width;
+    integral->height = height;
+    integral->rows = 0;
+
+    size_t entries = (size_t)(integral->width + 1) * (integral->height + 1) * 3;
+    integral->sum = calloc(entries, sizeof(uint64_t));
+    integral->sum_sq = calloc(entries, sizeof(uint64_t));
+    if (!integral->sum || !integral->sum_sq) {
+        fprintf(stderr, "Failed to malloc integral image\n");
+        integral_deinit(integral);
+        return false;
+    }
+
+    return true;
+}
+
+void integral_push_row(IntegralImage *integral, const uint8_t *pixels) {
+    uint32_t row = integral->rows++;
+    const uint64_t *above_sum = &integral->sum[integral_index(integral, row, 0)];
+    const uint64_t *above_sum_sq = &integral->sum_sq[integral_index(integral, row, 0)];
+    uint64_t *sum = &integral->sum[integral_index(integral, row + 1, 0)];
+    uint64_t *sum_sq = &integral->sum_sq[integral_index(integral, row + 1, 0)];
+
+    uint64_t row_sum[3] = {0};
+    uint64_t row_sum_sq[3] = {0};
+    for (uint32_t column = 0; column < integral->width; column++) {
+        for (size_t channel = 0; channel < 3; channel++) {
+            uint64_t value = pixels[column * 3 + channel];
+            row_sum[channel] += value;
+            row_sum_sq[channel] += value * value;
+
+            size_t index = (column + 1) * 3 + channel;
+            sum[index] = above_sum[index] + row_sum[channel];
+            sum_sq[index] = above_sum_sq[index] + row_sum_sq[channel];
+        }
+    }
+}
+
+void integral_deinit(IntegralImage *integral) {
+    free(integral->sum);
+    free(integral->sum_sq);
+    integral->sum = nullptr;
+    integral->sum_sq = nullptr;
+}
+
+Moments integral_moments(const IntegralImage *integral, const Box *box) {
+    size_t top_left = integral_index(integral, box->top, box->left);
+    size_t top_right = integral_index(integral, box->top, box->right);
+    size_t bottom_left = integral_index(integral, box->bottom, box->left);
+    size_t bottom_right = integral_index(integral, box->bottom, box->right);
+
+    Moments moments = {
+        .count = (uint64_t)(box->right - box->left) * (box->bottom - box->top)
+    };
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        moments.sum[channel] = integral->sum[bottom_right + channel] - integral->sum[top_right + channel]
+            - integral->sum[bottom_left + channel] + integral->sum[top_left + channel];
+        moments.sum_sq[channel] = integral->sum_sq[bottom_right + channel] - integral->sum_sq[top_right + channel]
+            - integral->sum_sq[bottom_left + channel] + integral->sum_sq[top_left + channel];
+    }
+
+    return moments;
+}
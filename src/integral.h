@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "quad.h"
+
+// Summed-area tables over an image: entry (row, column) holds the per channel
+// sum (and sum of squares) of every pixel above and to the left of it. Tables
+// are (width + 1) x (height + 1) so the first row and column are zero.
+typedef struct IntegralImage {
+    uint64_t *sum;
+    uint64_t *sum_sq;
+    uint32_t width;
+    uint32_t height;
+    // rows pushed so far, the tables are complete once this reaches height
+    uint32_t rows;
+} IntegralImage;
+
+// Allocates empty tables to be filled one row at a time with integral_push_row,
+// so a decoder can hand over scanlines without keeping the whole image around.
+bool integral_alloc(IntegralImage *integral, uint32_t width, uint32_t height);
+// accumulates the next row of `width` RGB pixels
+void integral_push_row(IntegralImage *integral, const uint8_t *pixels);
+void integral_deinit(IntegralImage *integral);
+Moments integral_moments(const IntegralImage *integral, const Box *box);
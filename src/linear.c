@@ -0,0 +1,217 @@
+#include <stddef.h>
+#include <stdio.h>
+
+#include "linear.h"
+#include "moments.h"
+#include "stb_ds.h"
+
+// spreads the 32 bits of `value` over the even bits of the result
+static uint64_t morton_spread(uint32_t value) {
+    uint64_t x = value;
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFF;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0F;
+    x = (x | (x << 2)) & 0x3333333333333333;
+    x = (x | (x << 1)) & 0x5555555555555555;
+    return x;
+}
+
+static uint32_t morton_compact(uint64_t value) {
+    uint64_t x = value & 0x5555555555555555;
+    x = (x | (x >> 1)) & 0x3333333333333333;
+    x = (x | (x >> 2)) & 0x0F0F0F0F0F0F0F0F;
+    x = (x | (x >> 4)) & 0x00FF00FF00FF00FF;
+    x = (x | (x >> 8)) & 0x0000FFFF0000FFFF;
+    x = (x | (x >> 16)) & 0x00000000FFFFFFFF;
+    return x;
+}
+
+uint32_t linear_level(uint64_t key) {
+    return (63 - __builtin_clzll(key)) / 2;
+}
+
+uint64_t linear_key(uint32_t level, uint32_t x, uint32_t y) {
+    return (1ull << (2 * level)) | morton_spread(x) | (morton_spread(y) << 1);
+}
+
+void linear_cell(uint64_t key, uint32_t *x, uint32_t *y) {
+    uint64_t code = key & ~(1ull << (2 * linear_level(key)));
+    *x = morton_compact(code);
+    *y = morton_compact(code >> 1);
+}
+
+uint64_t linear_neighbour(uint64_t key, int32_t dx, int32_t dy) {
+    uint32_t level = linear_level(key);
+    uint32_t x, y;
+    linear_cell(key, &x, &y);
+
+    int64_t size = 1ll << level;
+    int64_t nx = (int64_t)x + dx;
+    int64_t ny = (int64_t)y + dy;
+    if (nx < 0 || ny < 0 || nx >= size || ny >= size) {
+        return 0;
+    }
+
+    return linear_key(level, nx, ny);
+}
+
+static void linear_put(LinearTree *tree, uint64_t key, const Moments *moments) {
+    hmput(tree->nodes, key, color_from_moments(moments));
+}
+
+bool linear_init(LinearTree *tree, const Image *image) {
+    tree->image = image;
+    tree->nodes = nullptr;
+    tree->queued = nullptr;
+    tree->min_leaf = 1;
+
+    Box box = { .left = 0, .right = image->width, .top = 0, .bottom = image->height };
+    Moments moments = box_moments(image, &box);
+    linear_put(tree, LINEAR_ROOT, &moments);
+
+    return true;
+}
+
+void linear_deinit(LinearTree *tree) {
+    hmfree(tree->nodes);
+    arrfree(tree->queued);
+}
+
+static void linear_build_node(LinearTree *tree, uint64_t key, const Box *box, uint32_t depth, Moments *moments) {
+    if (depth == 0 || !box_can_split_to(box, tree->min_leaf)) {
+        *moments = box_moments(tree->image, box);
+        linear_put(tree, key, moments);
+        return;
+    }
+
+    Box boxes[4];
+    box_split(box, boxes);
+
+    *moments = (Moments) {0};
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        Moments child;
+        linear_build_node(tree, linear_child(key, quadrant), &boxes[quadrant], depth - 1, &child);
+        moments_merge(moments, &child);
+    }
+
+    linear_put(tree, key, moments);
+}
+
+bool linear_build(LinearTree *tree, uint32_t depth) {
+    if (depth > LINEAR_MAX_LEVEL) {
+        fprintf(stderr, "Linear quadtree depth is limited to %d\n", LINEAR_MAX_LEVEL);
+        return false;
+    }
+
+    hmfree(tree->nodes);
+
+    Box box = { .left = 0, .right = tree->image->width, .top = 0, .bottom = tree->image->height };
+    Moments moments;
+    linear_build_node(tree, LINEAR_ROOT, &box, depth, &moments);
+
+    return true;
+}
+
+static bool linear_can_split(const LinearTree *tree, uint64_t key, const Box *box) {
+    return linear_level(key) < LINEAR_MAX_LEVEL && box_can_split_to(box, tree->min_leaf);
+}
+
+static void linear_split_box(LinearTree *tree, uint64_t key, const Box *box) {
+    Box boxes[4];
+    box_split(box, boxes);
+
+    for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+        Moments moments = box_moments(tree->image, &boxes[quadrant]);
+        linear_put(tree, linear_child(key, quadrant), &moments);
+    }
+}
+
+bool linear_split(LinearTree *tree, uint64_t key) {
+    Box box = linear_box(tree, key);
+    if (!linear_can_split(tree, key, &box)) {
+        return false;
+    }
+
+    linear_split_box(tree, key, &box);
+    return true;
+}
+
+// queues the node under its key if it can be split at all, the heap only holds
+// 32 bit indices so the key goes into `queued`
+static bool linear_push(LinearTree *tree, PackedHeap *heap, uint64_t key) {
+    Box box = linear_box(tree, key);
+    if (!linear_can_split(tree, key, &box)) {
+        return true;
+    }
+
+    if (arrlenu(tree->queued) >= UINT32_MAX) {
+        return false;
+    }
+    AverageColor value = hmget(tree->nodes, key);
+    arrput(tree->queued, key);
+    return packed_heap_push(heap, arrlen(tree->queued) - 1, score_quad(heap->score, value.error, value.color, &box));
+}
+
+bool linear_push_leaves(LinearTree *tree, PackedHeap *heap) {
+    for (ptrdiff_t i = 0; i < hmlen(tree->nodes); i++) {
+        uint64_t key = tree->nodes[i].key;
+        if (linear_is_leaf(tree, key) && !linear_push(tree, heap, key)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t linear_refine(LinearTree *tree, PackedHeap *heap, size_t count, float error, bool *out_of_memory) {
+    size_t splits = 0;
+    *out_of_memory = false;
+
+    while (splits < count && heap->length > 0) {
+        // leaves below the threshold are retired, see session_refine
+        uint64_t key = tree->queued[packed_heap_pop(heap)];
+        if (hmget(tree->nodes, key).error < error) {
+            continue;
+        }
+
+        // only splittable nodes are queued
+        Box box = linear_box(tree, key);
+        linear_split_box(tree, key, &box);
+        splits++;
+
+        for (uint32_t quadrant = 0; quadrant < 4; quadrant++) {
+            uint64_t child = linear_child(key, quadrant);
+            if (hmget(tree->nodes, child).error < error) {
+                continue;
+            }
+            if (!linear_push(tree, heap, child)) {
+                *out_of_memory = true;
+                return splits;
+            }
+        }
+    }
+
+    return splits;
+}
+
+// lookups go through the _ts variant so readers never write to the shared map
+bool linear_contains(const LinearTree *tree, uint64_t key) {
+    LinearNode *nodes = tree->nodes;
+    ptrdiff_t temp;
+    return hmgeti_ts(nodes, key, temp) >= 0;
+}
+
+bool linear_is_leaf(const LinearTree *tree, uint64_t key) {
+    return linear_level(key) >= LINEAR_MAX_LEVEL || !linear_contains(tree, linear_child(key, 0));
+}
+
+Box linear_box(const LinearTree *tree, uint64_t key) {
+    Box box = { .left = 0, .right = tree->image->width, .top = 0, .bottom = tree->image->height };
+
+    for (uint32_t level = linear_level(key); level > 0; level--) {
+        Box boxes[4];
+        box_split(&box, boxes);
+        box = boxes[(key >> (2 * (level - 1))) & 3];
+    }
+
+    return box;
+}
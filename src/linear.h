@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "heap.h"
+#include "quad.h"
+
+// Linear quadtree: nodes are addressed by a locational code, a sentinel bit
+// followed by the Morton code (interleaved y, x bits) of the cell at that level,
+// so the root is 1 and the children of k are k * 4 + 0..3 in top left, top
+// right, bottom left, bottom right order. Nodes live in a hash map keyed by that
+// code, there are no child pointers; parents, children and neighbours are
+// computed from the key alone.
+#define LINEAR_ROOT 1
+#define LINEAR_MAX_LEVEL 31
+
+typedef struct {
+    uint64_t key;
+    AverageColor value;
+} LinearNode;
+
+typedef struct {
+    const Image *image;
+    LinearNode *nodes; // stb_ds hash map
+    // stb_ds array of the keys queued for refinement, the heap holds their index
+    uint64_t *queued;
+    // smallest side a split may leave a child with, 1 unless set after init
+    uint32_t min_leaf;
+} LinearTree;
+
+static inline uint64_t linear_parent(uint64_t key) {
+    return key >> 2;
+}
+
+static inline uint64_t linear_child(uint64_t key, uint32_t quadrant) {
+    return (key << 2) | quadrant;
+}
+
+uint32_t linear_level(uint64_t key);
+uint64_t linear_key(uint32_t level, uint32_t x, uint32_t y);
+void linear_cell(uint64_t key, uint32_t *x, uint32_t *y);
+
+// key of the cell `dx`, `dy` cells away on the same level, 0 when it falls outside
+uint64_t linear_neighbour(uint64_t key, int32_t dx, int32_t dy);
+
+bool linear_init(LinearTree *tree, const Image *image);
+void linear_deinit(LinearTree *tree);
+
+// builds every level down to `depth` bottom-up from a fresh root, stopping at `min_leaf`
+bool linear_build(LinearTree *tree, uint32_t depth);
+bool linear_split(LinearTree *tree, uint64_t key);
+
+// Queues every leaf that can be split, scored with the heap's scoring.
+bool linear_push_leaves(LinearTree *tree, PackedHeap *heap);
+// Splits the highest priority leaves like tree_refine, computing the four child
+// keys of each instead of allocating nodes. Returns the number of splits.
+size_t linear_refine(LinearTree *tree, PackedHeap *heap, size_t count, float error, bool *out_of_memory);
+
+bool linear_contains(const LinearTree *tree, uint64_t key);
+bool linear_is_leaf(const LinearTree *tree, uint64_t key);
+// the image area of a node, derived by replaying the splits along its key
+Box linear_box(const LinearTree *tree, uint64_t key);
@@ -4,19 +4,17 @@
 #include <SDL3/SDL.h>
 #include <stdlib.h>
 
-#include "heap.h"
+#include "batch.h"
+#include "bench.h"
+#include "headless.h"
+#include "image.h"
+#include "options.h"
+#include "pool.h"
 #include "quad.h"
-#include "stb_image.h"
+#include "render.h"
+#include "session.h"
 #include "stb_ds.h"
 
-const uint32_t PADDING = 1;
-
-typedef struct {
-    uint32_t *data;
-    uint32_t width;
-    uint32_t height;
-} Framebuffer;
-
 typedef struct {
     SDL_Window *window;
     SDL_Renderer *renderer;
@@ -31,12 +29,9 @@ bool context_init(SDLContext *context, int window_width, int window_height, int
         return false;
     }
 
-    context->framebuffer->width = image_width;
-    context->framebuffer->height = image_height;
-
-    context->framebuffer->data = malloc(sizeof(uint32_t) * image_height * image_width);
-    if (!context->framebuffer->data) {
-        fprintf(stderr, "Failed to malloc framebuffer data\n");
+    if (!framebuffer_init(context->framebuffer, image_width, image_height)) {
+        free(context->framebuffer);
+        context->framebuffer = nullptr;
         return false;
     }
 
@@ -76,56 +71,118 @@ void context_deinit(SDLContext *context) {
     if (context->window) {
         SDL_DestroyWindow(context->window);
     }
+    if (context->framebuffer) {
+        framebuffer_deinit(context->framebuffer);
+        free(context->framebuffer);
+    }
 
     SDL_Quit();
 }
 
-void draw_rectangle(Framebuffer *framebuffer, uint32_t left, uint32_t top, uint32_t width, uint32_t height, uint32_t color) {
-    for (size_t row = top; row < top + height; row++) {
-        for (size_t column = left; column < left + width; column++) {
-            framebuffer->data[row * framebuffer->width + column] = color;
-        }
+// past this many split quads a frame uploads their bounding box in one call
+#define DIRTY_RECTS_MAX 64
+
+void draw_image(const SDLContext *context, const Session *session, Pool *pool) {
+    render_quads(context->framebuffer, &session->root, pool);
+
+    SDL_UpdateTexture(context->texture, nullptr, context->framebuffer->data, sizeof(uint32_t) * context->framebuffer->width);
+}
+
+// draws a pyramid level in place of the quads, the splits keep going underneath
+void draw_preview(const SDLContext *context, const Image *image, uint32_t level) {
+    Framebuffer *framebuffer = context->framebuffer;
+    draw_rectangle(framebuffer, 0, 0, framebuffer->width, framebuffer->height, 0xFF000000);
+    render_pyramid(framebuffer, image->pyramid, level);
+
+    SDL_UpdateTexture(context->texture, nullptr, framebuffer->data, sizeof(uint32_t) * framebuffer->width);
+}
+
+static void upload_rect(const SDLContext *context, uint32_t left, uint32_t top, uint32_t right, uint32_t bottom) {
+    if (right <= left || bottom <= top) {
+        return;
     }
+
+    const Framebuffer *framebuffer = context->framebuffer;
+    SDL_Rect rect = { .x = left, .y = top, .w = right - left, .h = bottom - top };
+    const uint32_t *pixels = &framebuffer->data[(size_t)top * framebuffer->width + left];
+    SDL_UpdateTexture(context->texture, &rect, pixels, sizeof(uint32_t) * framebuffer->width);
 }
 
-void draw_image(const SDLContext *context, Heap *heap) {
-    // clear framebuffer with black
-    draw_rectangle(context->framebuffer, 0, 0, context->framebuffer->width, context->framebuffer->height, 0xFF000000);
+// repaints and uploads only the boxes of the quads split since the last frame
+void draw_dirty(const SDLContext *context, const Session *session) {
+    size_t count = arrlenu(session->dirty);
+    Box bounds = { .left = UINT32_MAX, .right = 0, .top = UINT32_MAX, .bottom = 0 };
 
-    for (size_t i = 0; i < heap->length; i++) {
-        const Quad *quad = heap->data[i].quad;
+    for (size_t i = 0; i < count; i++) {
+        const Box *box = &session->dirty[i]->boundary.box;
+        render_split(context->framebuffer, session->dirty[i]);
 
-        Box box = quad->boundary.box;
-        uint32_t color = (0xFF << 24) | (quad->average_color.color.red << 16) | (quad->average_color.color.green << 8) | (quad->average_color.color.blue);
-        draw_rectangle(
-            context->framebuffer,
-            box.left + PADDING,
-            box.top + PADDING,
-            box.right - box.left - PADDING,
-            box.bottom - box.top - PADDING,
-            color
-        );
+        if (count <= DIRTY_RECTS_MAX) {
+            upload_rect(context, box->left + PADDING, box->top + PADDING, box->right, box->bottom);
+            continue;
+        }
+
+        bounds.left = box->left < bounds.left ? box->left : bounds.left;
+        bounds.right = box->right > bounds.right ? box->right : bounds.right;
+        bounds.top = box->top < bounds.top ? box->top : bounds.top;
+        bounds.bottom = box->bottom > bounds.bottom ? box->bottom : bounds.bottom;
     }
 
-    SDL_UpdateTexture(context->texture, nullptr, context->framebuffer->data, sizeof(uint32_t) * context->framebuffer->width);
+    if (count > DIRTY_RECTS_MAX) {
+        upload_rect(context, bounds.left + PADDING, bounds.top + PADDING, bounds.right, bounds.bottom);
+    }
+}
+
+void update_title(const SDLContext *context, const Session *session, size_t frames) {
+    char title[128];
+    snprintf(title, sizeof(title), "Quadtree art - %zu splits, %zu frames", session->splits, frames);
+    SDL_SetWindowTitle(context->window, title);
+}
+
+void present(const SDLContext *context) {
     SDL_RenderTexture(context->renderer, context->texture, nullptr, nullptr);
     SDL_RenderPresent(context->renderer);
 }
 
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stdout, "Usage: %s <image>\n", argv[0]);
+    if (argc < 2) {
+        options_usage(stdout, argv[0]);
         return 0;
     }
 
+    Options options;
+    if (!options_parse(&options, argc, argv)) {
+        options_usage(stderr, argv[0]);
+        return -1;
+    }
+
+    if (options.bench) {
+        return bench_heaps(options.splits, options.buckets, options.score) ? 0 : -1;
+    }
+
+    if (options.batch) {
+        return batch_run(&options) ? 0 : -1;
+    }
+
+    Pool pool;
+    if (!pool_init(&pool, options.threads)) {
+        return -1;
+    }
+
+    if (options.headless) {
+        bool ok = headless_run(&options, options.input, options.output, &pool, nullptr);
+        pool_deinit(&pool);
+        return ok ? 0 : -1;
+    }
+
+    ImageConfig image_config = options_image_config(&options);
     Image image;
-    image.data = stbi_load(argv[1], &image.width, &image.height, nullptr, 3);
-    if (!image.data) {
-        fprintf(stderr, "Failed to load image %s\n", argv[1]);
+    if (!image_load(&image, options.input, &image_config)) {
+        pool_deinit(&pool);
         return -1;
     }
 
-    SDLContext context;
+    SDLContext context = {0};
 
     int window_width = image.width + PADDING;
     int window_height = image.height + PADDING;
@@ -143,38 +200,98 @@ int main(int argc, char **argv) {
 
     if (!context_init(&context, window_width + PADDING, window_height + PADDING, image.width + PADDING, image.height + PADDING)) {
         context_deinit(&context);
+        image_free(&image);
+        pool_deinit(&pool);
         return -1;
     }
 
-    Heap heap;
-    heap_init(&heap);
+    SessionConfig config = options_session_config(&options);
+    // frames repaint only the quads split since the last one
+    config.track_dirty = true;
+    Session session;
+    if (!session_init(&session, &image, &config)) {
+        context_deinit(&context);
+        image_free(&image);
+        pool_deinit(&pool);
+        return -1;
+    }
+
+    if (options.render == RENDER_VSYNC && !SDL_SetRenderVSync(context.renderer, 1)) {
+        fprintf(stderr, "SDL set vsync failed: %s\n", SDL_GetError());
+    }
 
-    Quad root = quad_init_from_image(&image);
-    heap_push(&heap, &root);
+    // the texture keeps the last frame, so only splits need repainting and
+    // uploading, window events just present it again
+    draw_image(&context, &session, &pool);
+    session_clear_dirty(&session);
+    bool needs_present = true;
+    size_t frames = 0;
+    // cleared once the session runs out of quads to split
+    bool auto_refine = options.auto_refine_ns > 0;
+    bool paused = false;
+    // P steps through the pyramid levels finest first, 0 shows the quads
+    uint32_t preview = 0;
 
     SDL_Event event;
     bool quit = false;
     while (!quit) {
-        while (SDL_PollEvent(&event)) {
+        // wait blocks until the next event unless auto refining, vsync and poll
+        // keep presenting and only check for events in between
+        bool refining = auto_refine && !paused;
+        bool has_event = options.render == RENDER_WAIT && !refining ? SDL_WaitEvent(&event) : SDL_PollEvent(&event);
+        while (has_event) {
             if (event.type == SDL_EVENT_QUIT) {
                 quit = true;
             }
-            if (event.type == SDL_EVENT_KEY_DOWN) {
-                for (size_t i = 0; i < 10; i++) {
-                    Quad *quad = heap_pop(&heap);
-                    Children *children = quad_split(quad);
-                    heap_push(&heap, &children->top_left);
-                    heap_push(&heap, &children->top_right);
-                    heap_push(&heap, &children->bottom_left);
-                    heap_push(&heap, &children->bottom_right);
+            if (event.type == SDL_EVENT_KEY_DOWN && auto_refine && event.key.key == SDLK_SPACE) {
+                paused = !paused;
+            } else if (event.type == SDL_EVENT_KEY_DOWN && image.pyramid && event.key.key == SDLK_P) {
+                preview = (preview + 1) % (image.pyramid->count + 1);
+                if (preview > 0) {
+                    draw_preview(&context, &image, preview - 1);
+                } else {
+                    draw_image(&context, &session, &pool);
                 }
+                session_clear_dirty(&session);
+                needs_present = true;
+            } else if (event.type == SDL_EVENT_KEY_DOWN) {
+                session_refine(&session, 10, 0);
+            }
+            if (event.type == SDL_EVENT_WINDOW_EXPOSED || event.type == SDL_EVENT_WINDOW_RESIZED || event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED) {
+                needs_present = true;
             }
+            has_event = SDL_PollEvent(&event);
         }
 
-        draw_image(&context, &heap);
+        if (refining && session_refine_for(&session, options.auto_refine_ns, 0) == 0) {
+            auto_refine = false;
+        }
+
+        // leaving the preview redraws every quad, its splits need no repainting
+        if (preview > 0 && arrlenu(session.dirty) > 0) {
+            session_clear_dirty(&session);
+            update_title(&context, &session, frames + 1);
+        } else if (arrlenu(session.dirty) > 0) {
+            draw_dirty(&context, &session);
+            session_clear_dirty(&session);
+            needs_present = true;
+            update_title(&context, &session, frames + 1);
+        }
+
+        // vsync presents every frame, the present call paces the loop
+        if (needs_present || options.render != RENDER_WAIT) {
+            present(&context);
+            frames++;
+            needs_present = false;
+        }
     }
 
+    printf("Rendered %zu frames, %zu splits\n", frames, session.splits);
+
     context_deinit(&context);
+    session_deinit(&session);
+    image_free(&image);
+    pool_deinit(&pool);
 
     return 0;
 }
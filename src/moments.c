@@ -0,0 +1,385 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+#include "moments.h"
+
+#ifdef CPU_X86
+#include <immintrin.h>
+#endif
+
+static void moments_scan_row_scalar(const uint8_t *pixels, size_t count, Moments *moments) {
+    uint64_t sum[3] = {0};
+    uint64_t sum_sq[3] = {0};
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t channel = 0; channel < 3; channel++) {
+            uint64_t value = pixels[i * 3 + channel];
+            sum[channel] += value;
+            sum_sq[channel] += value * value;
+        }
+    }
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        moments->sum[channel] += sum[channel];
+        moments->sum_sq[channel] += sum_sq[channel];
+    }
+}
+
+// RGBX rows, the pad byte is skipped
+static void moments_scan_row_rgbx_scalar(const uint8_t *pixels, size_t count, Moments *moments) {
+    uint64_t sum[3] = {0};
+    uint64_t sum_sq[3] = {0};
+
+    for (size_t i = 0; i < count; i++) {
+        for (size_t channel = 0; channel < 3; channel++) {
+            uint64_t value = pixels[i * 4 + channel];
+            sum[channel] += value;
+            sum_sq[channel] += value * value;
+        }
+    }
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        moments->sum[channel] += sum[channel];
+        moments->sum_sq[channel] += sum_sq[channel];
+    }
+}
+
+// a row of one channel of a planar image
+static void moments_scan_plane_scalar(const uint8_t *values, size_t count, uint64_t *sum, uint64_t *sum_sq) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t value = values[i];
+        *sum += value;
+        *sum_sq += value * value;
+    }
+}
+
+#ifdef CPU_X86
+
+// Squares are summed into 32 bit lanes, each iteration adds at most 4 * 255^2 per
+// lane, so they are flushed to 64 bits well before they could overflow.
+#define MOMENTS_FLUSH_INTERVAL 4096
+
+__attribute__((target("sse4.1")))
+static void moments_scan_row_sse41(const uint8_t *pixels, size_t count, Moments *moments) {
+    // pshufb masks gathering one channel of 16 interleaved RGB pixels (48 bytes,
+    // three registers) into a single register
+    const __m128i shuffle[3][3] = {
+        {
+            _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+            _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1),
+            _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13),
+        },
+        {
+            _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+            _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1),
+            _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14),
+        },
+        {
+            _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1),
+            _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1),
+            _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15),
+        },
+    };
+    const __m128i zero = _mm_setzero_si128();
+
+    __m128i sum[3] = { zero, zero, zero };
+    __m128i sum_sq[3] = { zero, zero, zero };
+    __m128i sum_sq_wide[3] = { zero, zero, zero };
+
+    size_t i = 0;
+    size_t iterations = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)&pixels[i * 3]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&pixels[i * 3 + 16]);
+        __m128i c = _mm_loadu_si128((const __m128i *)&pixels[i * 3 + 32]);
+
+        for (size_t channel = 0; channel < 3; channel++) {
+            __m128i values = _mm_or_si128(
+                _mm_or_si128(_mm_shuffle_epi8(a, shuffle[channel][0]), _mm_shuffle_epi8(b, shuffle[channel][1])),
+                _mm_shuffle_epi8(c, shuffle[channel][2])
+            );
+
+            __m128i low = _mm_cvtepu8_epi16(values);
+            __m128i high = _mm_unpackhi_epi8(values, zero);
+
+            sum[channel] = _mm_add_epi64(sum[channel], _mm_sad_epu8(values, zero));
+            sum_sq[channel] = _mm_add_epi32(sum_sq[channel], _mm_madd_epi16(low, low));
+            sum_sq[channel] = _mm_add_epi32(sum_sq[channel], _mm_madd_epi16(high, high));
+        }
+
+        if (++iterations == MOMENTS_FLUSH_INTERVAL) {
+            for (size_t channel = 0; channel < 3; channel++) {
+                sum_sq_wide[channel] = _mm_add_epi64(sum_sq_wide[channel], _mm_unpacklo_epi32(sum_sq[channel], zero));
+                sum_sq_wide[channel] = _mm_add_epi64(sum_sq_wide[channel], _mm_unpackhi_epi32(sum_sq[channel], zero));
+                sum_sq[channel] = zero;
+            }
+            iterations = 0;
+        }
+    }
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        sum_sq_wide[channel] = _mm_add_epi64(sum_sq_wide[channel], _mm_unpacklo_epi32(sum_sq[channel], zero));
+        sum_sq_wide[channel] = _mm_add_epi64(sum_sq_wide[channel], _mm_unpackhi_epi32(sum_sq[channel], zero));
+
+        uint64_t lanes[2][2];
+        _mm_storeu_si128((__m128i *)lanes[0], sum[channel]);
+        _mm_storeu_si128((__m128i *)lanes[1], sum_sq_wide[channel]);
+
+        moments->sum[channel] += lanes[0][0] + lanes[0][1];
+        moments->sum_sq[channel] += lanes[1][0] + lanes[1][1];
+    }
+
+    moments_scan_row_scalar(&pixels[i * 3], count - i, moments);
+}
+
+// adds 32 bytes of one channel to 64 bit sums and 32 bit sums of squares
+__attribute__((target("avx2")))
+static inline void moments_accumulate_avx2(__m256i values, __m256i *sum, __m256i *sum_sq) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i low = _mm256_unpacklo_epi8(values, zero);
+    __m256i high = _mm256_unpackhi_epi8(values, zero);
+
+    *sum = _mm256_add_epi64(*sum, _mm256_sad_epu8(values, zero));
+    *sum_sq = _mm256_add_epi32(*sum_sq, _mm256_madd_epi16(low, low));
+    *sum_sq = _mm256_add_epi32(*sum_sq, _mm256_madd_epi16(high, high));
+}
+
+// folds the 32 bit sums of squares into the 64 bit ones before they can overflow
+__attribute__((target("avx2")))
+static inline void moments_flush_avx2(__m256i *sum_sq, __m256i *sum_sq_wide) {
+    const __m256i zero = _mm256_setzero_si256();
+    *sum_sq_wide = _mm256_add_epi64(*sum_sq_wide, _mm256_unpacklo_epi32(*sum_sq, zero));
+    *sum_sq_wide = _mm256_add_epi64(*sum_sq_wide, _mm256_unpackhi_epi32(*sum_sq, zero));
+    *sum_sq = zero;
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t moments_reduce_avx2(__m256i value) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, value);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// 32 RGBX pixels in four registers: pshufb groups each channel of four pixels
+// into one 32 bit lane, and two rounds of unpacks transpose the registers into
+// one register per channel, which then sums exactly like a plane.
+__attribute__((target("avx2")))
+static inline void moments_accumulate_rgbx_avx2(const __m256i pixels[static 4], __m256i sum[static 3], __m256i sum_sq[static 3]) {
+    const __m256i group = _mm256_setr_epi8(
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+        0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15
+    );
+
+    __m256i a = _mm256_shuffle_epi8(pixels[0], group);
+    __m256i b = _mm256_shuffle_epi8(pixels[1], group);
+    __m256i c = _mm256_shuffle_epi8(pixels[2], group);
+    __m256i d = _mm256_shuffle_epi8(pixels[3], group);
+
+    __m256i red_green_ab = _mm256_unpacklo_epi32(a, b);
+    __m256i blue_pad_ab = _mm256_unpackhi_epi32(a, b);
+    __m256i red_green_cd = _mm256_unpacklo_epi32(c, d);
+    __m256i blue_pad_cd = _mm256_unpackhi_epi32(c, d);
+
+    moments_accumulate_avx2(_mm256_unpacklo_epi64(red_green_ab, red_green_cd), &sum[0], &sum_sq[0]);
+    moments_accumulate_avx2(_mm256_unpackhi_epi64(red_green_ab, red_green_cd), &sum[1], &sum_sq[1]);
+    moments_accumulate_avx2(_mm256_unpacklo_epi64(blue_pad_ab, blue_pad_cd), &sum[2], &sum_sq[2]);
+}
+
+// The accumulators live across every row of the box and are reduced once. An
+// RGBX pixel is one 32 bit lane, so the last 1..31 pixels of a row are masked
+// loads whose lanes past the end read as zero and add nothing.
+__attribute__((target("avx2")))
+static void moments_scan_rgbx_avx2(const Image *image, const Box *box, Moments *moments) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    __m256i sum[3] = { zero, zero, zero };
+    __m256i sum_sq[3] = { zero, zero, zero };
+    __m256i sum_sq_wide[3] = { zero, zero, zero };
+
+    size_t count = box->right - box->left;
+    size_t iterations = 0;
+    for (uint32_t row = box->top; row < box->bottom; row++) {
+        const uint8_t *pixels = &image->data[(size_t)row * image->stride + (size_t)box->left * 4];
+
+        for (size_t i = 0; i < count; i += 32) {
+            __m256i block[4];
+            if (i + 32 <= count) {
+                for (size_t j = 0; j < 4; j++) {
+                    block[j] = _mm256_loadu_si256((const __m256i *)&pixels[(i + j * 8) * 4]);
+                }
+            } else {
+                int32_t rest = count - i;
+                for (size_t j = 0; j < 4; j++) {
+                    __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(rest - (int32_t)j * 8), lanes);
+                    block[j] = _mm256_maskload_epi32((const int *)&pixels[(i + j * 8) * 4], mask);
+                }
+            }
+            moments_accumulate_rgbx_avx2(block, sum, sum_sq);
+
+            if (++iterations == MOMENTS_FLUSH_INTERVAL) {
+                for (size_t channel = 0; channel < 3; channel++) {
+                    moments_flush_avx2(&sum_sq[channel], &sum_sq_wide[channel]);
+                }
+                iterations = 0;
+            }
+        }
+    }
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        moments_flush_avx2(&sum_sq[channel], &sum_sq_wide[channel]);
+        moments->sum[channel] += moments_reduce_avx2(sum[channel]);
+        moments->sum_sq[channel] += moments_reduce_avx2(sum_sq_wide[channel]);
+    }
+}
+
+// 32 zero bytes then 32 set ones, a register loaded from `&moments_tail_mask[n]`
+// keeps its bytes from 32 - n on
+static const uint8_t moments_tail_mask[64] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+// The bytes [i, count) of a row of at least 8 bytes, zero padded. Rather than
+// reading past the row the loads end at its last byte and mask off the bytes
+// before `i`, rows under 32 bytes are put together from 16 or 8 byte halves.
+__attribute__((target("avx2")))
+static inline __m256i moments_load_tail_avx2(const uint8_t *values, size_t i, size_t count) {
+    size_t rest = count - i;
+    if (count >= 32) {
+        __m256i last = _mm256_loadu_si256((const __m256i *)&values[count - 32]);
+        return _mm256_and_si256(last, _mm256_loadu_si256((const __m256i *)&moments_tail_mask[rest]));
+    }
+
+    if (count >= 16) {
+        __m128i first = _mm_loadu_si128((const __m128i *)values);
+        __m128i last = _mm_loadu_si128((const __m128i *)&values[count - 16]);
+        last = _mm_and_si128(last, _mm_loadu_si128((const __m128i *)&moments_tail_mask[rest]));
+        return _mm256_set_m128i(last, first);
+    }
+
+    __m128i first = _mm_loadl_epi64((const __m128i *)values);
+    __m128i last = _mm_loadl_epi64((const __m128i *)&values[count - 8]);
+    last = _mm_and_si128(last, _mm_loadl_epi64((const __m128i *)&moments_tail_mask[rest + 16]));
+    return _mm256_set_m128i(_mm_setzero_si128(), _mm_unpacklo_epi64(first, last));
+}
+
+// 32 bytes of one channel per iteration, no shuffles at all, with the
+// accumulators kept across the rows of the box. Only rows under 8 pixels are
+// summed one byte at a time.
+__attribute__((target("avx2")))
+static void moments_scan_planar_avx2(const Image *image, const Box *box, Moments *moments) {
+    const __m256i zero = _mm256_setzero_si256();
+    size_t count = box->right - box->left;
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        const uint8_t *plane = &image->data[channel * image->plane];
+        if (count < 8) {
+            for (uint32_t row = box->top; row < box->bottom; row++) {
+                moments_scan_plane_scalar(&plane[(size_t)row * image->stride + box->left], count, &moments->sum[channel], &moments->sum_sq[channel]);
+            }
+            continue;
+        }
+
+        __m256i sums = zero;
+        __m256i squares = zero;
+        __m256i squares_wide = zero;
+
+        size_t iterations = 0;
+        for (uint32_t row = box->top; row < box->bottom; row++) {
+            const uint8_t *values = &plane[(size_t)row * image->stride + box->left];
+
+            for (size_t i = 0; i < count; i += 32) {
+                __m256i block = i + 32 <= count
+                    ? _mm256_loadu_si256((const __m256i *)&values[i])
+                    : moments_load_tail_avx2(values, i, count);
+                moments_accumulate_avx2(block, &sums, &squares);
+
+                if (++iterations == MOMENTS_FLUSH_INTERVAL) {
+                    moments_flush_avx2(&squares, &squares_wide);
+                    iterations = 0;
+                }
+            }
+        }
+
+        moments_flush_avx2(&squares, &squares_wide);
+        moments->sum[channel] += moments_reduce_avx2(sums);
+        moments->sum_sq[channel] += moments_reduce_avx2(squares_wide);
+    }
+}
+
+#endif
+
+static void moments_scan_rgb(const Image *image, const Box *box, Moments *moments) {
+    void (*scan_row)(const uint8_t *, size_t, Moments *) = moments_scan_row_scalar;
+#ifdef CPU_X86
+    if (cpu_has_sse41()) {
+        scan_row = moments_scan_row_sse41;
+    }
+#endif
+
+    for (uint32_t row = box->top; row < box->bottom; row++) {
+        scan_row(&image->data[(size_t)row * image->stride + (size_t)box->left * 3], box->right - box->left, moments);
+    }
+}
+
+static void moments_scan_rgbx(const Image *image, const Box *box, Moments *moments) {
+#ifdef CPU_X86
+    if (cpu_has_avx2()) {
+        moments_scan_rgbx_avx2(image, box, moments);
+        return;
+    }
+#endif
+
+    for (uint32_t row = box->top; row < box->bottom; row++) {
+        moments_scan_row_rgbx_scalar(&image->data[(size_t)row * image->stride + (size_t)box->left * 4], box->right - box->left, moments);
+    }
+}
+
+static void moments_scan_planar(const Image *image, const Box *box, Moments *moments) {
+#ifdef CPU_X86
+    if (cpu_has_avx2()) {
+        moments_scan_planar_avx2(image, box, moments);
+        return;
+    }
+#endif
+
+    for (size_t channel = 0; channel < 3; channel++) {
+        const uint8_t *plane = &image->data[channel * image->plane];
+        for (uint32_t row = box->top; row < box->bottom; row++) {
+            moments_scan_plane_scalar(&plane[(size_t)row * image->stride + box->left], box->right - box->left, &moments->sum[channel], &moments->sum_sq[channel]);
+        }
+    }
+}
+
+Moments moments_scan(const Image *image, const Box *box) {
+    Moments moments = {
+        .count = (uint64_t)(box->right - box->left) * (box->bottom - box->top)
+    };
+
+    switch (image->layout) {
+        case LAYOUT_RGBX:
+            moments_scan_rgbx(image, box, &moments);
+            break;
+        case LAYOUT_PLANAR:
+            moments_scan_planar(image, box, &moments);
+            break;
+        case LAYOUT_RGB:
+        default:
+            moments_scan_rgb(image, box, &moments);
+            break;
+    }
+
+    return moments;
+}
+
+void moments_merge(Moments *moments, const Moments *other) {
+    moments->count += other->count;
+    for (size_t channel = 0; channel < 3; channel++) {
+        moments->sum[channel] += other->sum[channel];
+        moments->sum_sq[channel] += other->sum_sq[channel];
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "quad.h"
+
+// Scans the pixels of `box` and accumulates per channel count, sum and sum of
+// squares directly, without going through a 768 bin histogram. Each pixel layout
+// has its own inner loop: packed RGB is deinterleaved with SSE4.1 row by row,
+// RGBX and planar boxes run 256 bits wide with AVX2, keeping the accumulators
+// across rows and finishing each row with masked vector loads.
+Moments moments_scan(const Image *image, const Box *box);
+
+void moments_merge(Moments *moments, const Moments *other);
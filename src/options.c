@@ -0,0 +1,337 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+#include "pool.h"
+
+static bool parse_size(const char *text, size_t *value) {
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno || end == text || *end != '\0' || text[0] == '-' || parsed > SIZE_MAX) {
+        return false;
+    }
+
+    *value = parsed;
+    return true;
+}
+
+static bool parse_float(const char *text, float *value) {
+    char *end;
+    errno = 0;
+    float parsed = strtof(text, &end);
+    if (errno || end == text || *end != '\0' || parsed < 0) {
+        return false;
+    }
+
+    *value = parsed;
+    return true;
+}
+
+static bool parse_stats(Options *options, const char *text) {
+    if (strcmp(text, "integral") == 0) {
+        options->integral = true;
+    } else if (strcmp(text, "moments") == 0) {
+        options->integral = false;
+        options->stats = STATS_MOMENTS;
+    } else if (strcmp(text, "histogram") == 0) {
+        options->integral = false;
+        options->stats = STATS_HISTOGRAM;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_backend(Options *options, const char *text) {
+    if (strcmp(text, "pointer") == 0) {
+        options->backend = BACKEND_POINTER;
+    } else if (strcmp(text, "soa") == 0) {
+        options->backend = BACKEND_SOA;
+    } else if (strcmp(text, "linear") == 0) {
+        options->backend = BACKEND_LINEAR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_decoder(Options *options, const char *text) {
+    if (strcmp(text, "auto") == 0) {
+        options->decoder = DECODER_AUTO;
+    } else if (strcmp(text, "stb") == 0) {
+        options->decoder = DECODER_STB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_layout(Options *options, const char *text) {
+    if (strcmp(text, "rgb") == 0) {
+        options->layout = LAYOUT_RGB;
+    } else if (strcmp(text, "rgbx") == 0) {
+        options->layout = LAYOUT_RGBX;
+    } else if (strcmp(text, "planar") == 0) {
+        options->layout = LAYOUT_PLANAR;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_heap(Options *options, const char *text) {
+    if (strcmp(text, "binary") == 0) {
+        options->heap = HEAP_BINARY;
+    } else if (strcmp(text, "4ary") == 0) {
+        options->heap = HEAP_QUATERNARY;
+    } else if (strcmp(text, "bucket") == 0) {
+        options->heap = HEAP_BUCKET;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_score(Options *options, const char *text) {
+    if (strcmp(text, "error") == 0) {
+        options->score = SCORE_ERROR;
+    } else if (strcmp(text, "area") == 0) {
+        options->score = SCORE_AREA;
+    } else if (strcmp(text, "sqrt") == 0) {
+        options->score = SCORE_SQRT_AREA;
+    } else if (strcmp(text, "root4") == 0) {
+        options->score = SCORE_ROOT4_AREA;
+    } else if (strcmp(text, "perceptual") == 0) {
+        options->score = SCORE_PERCEPTUAL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parse_render(Options *options, const char *text) {
+    if (strcmp(text, "wait") == 0) {
+        options->render = RENDER_WAIT;
+    } else if (strcmp(text, "vsync") == 0) {
+        options->render = RENDER_VSYNC;
+    } else if (strcmp(text, "poll") == 0) {
+        options->render = RENDER_POLL;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void options_usage(FILE *file, const char *program) {
+    fprintf(file,
+        "Usage: %s [options] <image>\n"
+        "       %s batch [options] <directory|list> <output directory>\n"
+        "       %s bench [--splits <n>] [--score <kind>]\n"
+        "\n"
+        "Options:\n"
+        "  --stats integral|moments|histogram  how quad colors are computed (default moments;\n"
+        "                                     integral is fastest but keeps 48 bytes per pixel)\n"
+        "  --layout rgb|rgbx|planar  pixel layout for --stats moments|histogram (default rgb)\n"
+        "  --pyramid on|off  cell moments mip chain for coarse quads and the viewer preview (default on)\n"
+        "  --decoder auto|stb  auto streams PPM and uses libjpeg/libpng when built in (default auto)\n"
+        "  --depth <n>       build the tree down to depth n bottom-up before refining\n"
+        "  --heap binary|4ary|bucket  priority queue (default binary), --tree soa|linear\n"
+        "                    always use a binary heap of 8 byte nodes\n"
+        "  --buckets <n>     bucket queue size (default 4096)\n"
+        "  --score error|area|sqrt|root4|perceptual  how errors are weighted by size (default root4)\n"
+        "  --min-leaf <n>    never split a quad into children under n pixels per side (default 2)\n"
+        "  --tree pointer|soa|linear  headless: tree storage (default pointer)\n"
+        "  --render wait|vsync|poll  viewer loop: block on events (default), pace to vsync or busy poll\n"
+        "  --auto-refine <ms>  viewer: split for up to ms milliseconds every frame, space pauses\n"
+        "  --tile <n>        headless, pointer tree: refine n x n tiles with their own trees in one\n"
+        "                    global order, decoding a band of n rows at a time, n at least\n"
+        "                    twice --min-leaf\n"
+        "  --headless        refine and write --output without opening a window\n"
+        "  --splits <n>      headless: number of splits (default 1000, unlimited with --error)\n"
+        "  --error <e>       headless: split every quad with an error of at least e\n"
+        "  --output <file>   headless: write the result as .png or .ppm\n"
+        "  --threads <n>     worker threads for batch images or banded rendering (default one per CPU)\n"
+        "  --format png|ppm  batch: output format (default png)\n",
+        program, program, program
+    );
+}
+
+bool options_parse(Options *options, int argc, char **argv) {
+    *options = (Options) {
+        .integral = false,
+        .pyramid = true,
+        .stats = STATS_MOMENTS,
+        .buckets = 4096,
+        .score = SCORE_ROOT4_AREA,
+        .min_leaf = 2,
+        .threads = pool_default_threads(),
+        .format = "png"
+    };
+
+    int first = 1;
+    if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+        options->batch = true;
+        options->headless = true;
+        first = 2;
+    } else if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        options->bench = true;
+        first = 2;
+    }
+
+    bool has_splits = false;
+    bool has_buckets = false;
+    for (int i = first; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+        if (strcmp(arg, "--headless") == 0) {
+            options->headless = true;
+            continue;
+        }
+
+        if (arg[0] != '-' || arg[1] == '\0') {
+            if (!options->input) {
+                options->input = arg;
+            } else if (options->batch && !options->output) {
+                options->output = arg;
+            } else {
+                fprintf(stderr, "Unexpected argument %s\n", arg);
+                return false;
+            }
+            continue;
+        }
+
+        if (!value) {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return false;
+        }
+        i++;
+
+        size_t depth = 0;
+        size_t min_leaf = 0;
+        size_t tile = 0;
+        bool ok = true;
+        if (strcmp(arg, "--stats") == 0) {
+            ok = parse_stats(options, value);
+        } else if (strcmp(arg, "--layout") == 0) {
+            ok = parse_layout(options, value);
+        } else if (strcmp(arg, "--pyramid") == 0) {
+            ok = strcmp(value, "on") == 0 || strcmp(value, "off") == 0;
+            options->pyramid = strcmp(value, "on") == 0;
+        } else if (strcmp(arg, "--decoder") == 0) {
+            ok = parse_decoder(options, value);
+        } else if (strcmp(arg, "--heap") == 0) {
+            ok = parse_heap(options, value);
+        } else if (strcmp(arg, "--buckets") == 0) {
+            ok = parse_size(value, &options->buckets) && options->buckets > 0;
+            has_buckets = true;
+        } else if (strcmp(arg, "--score") == 0) {
+            ok = parse_score(options, value);
+        } else if (strcmp(arg, "--min-leaf") == 0) {
+            ok = parse_size(value, &min_leaf) && min_leaf > 0 && min_leaf <= UINT32_MAX;
+            options->min_leaf = min_leaf;
+        } else if (strcmp(arg, "--auto-refine") == 0) {
+            float milliseconds = 0;
+            ok = parse_float(value, &milliseconds) && milliseconds > 0 && milliseconds <= 1000;
+            options->auto_refine_ns = milliseconds * 1e6;
+        } else if (strcmp(arg, "--render") == 0) {
+            ok = parse_render(options, value);
+        } else if (strcmp(arg, "--tile") == 0) {
+            ok = parse_size(value, &tile) && tile >= 2 && tile <= UINT32_MAX / 2;
+            options->tile = tile;
+        } else if (strcmp(arg, "--tree") == 0) {
+            ok = parse_backend(options, value);
+        } else if (strcmp(arg, "--depth") == 0) {
+            ok = parse_size(value, &depth) && depth <= 32;
+            options->depth = depth;
+        } else if (strcmp(arg, "--splits") == 0) {
+            ok = parse_size(value, &options->splits);
+            has_splits = true;
+        } else if (strcmp(arg, "--error") == 0) {
+            ok = parse_float(value, &options->error);
+        } else if (strcmp(arg, "--output") == 0) {
+            options->output = value;
+        } else if (strcmp(arg, "--threads") == 0) {
+            ok = parse_size(value, &options->threads) && options->threads > 0;
+        } else if (strcmp(arg, "--format") == 0) {
+            ok = strcmp(value, "png") == 0 || strcmp(value, "ppm") == 0;
+            options->format = value;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Invalid value %s for %s\n", value, arg);
+            return false;
+        }
+    }
+
+    if (options->bench) {
+        if (!has_splits) {
+            options->splits = 1000000;
+        }
+        return true;
+    }
+
+    if (!options->input) {
+        fprintf(stderr, "Missing input image\n");
+        return false;
+    }
+
+    if (options->batch && !options->output) {
+        fprintf(stderr, "Missing output directory\n");
+        return false;
+    }
+
+    if (options->headless && !options->output) {
+        fprintf(stderr, "--headless requires --output\n");
+        return false;
+    }
+
+    // the index based trees queue 32 bit node indices in a PackedHeap
+    if (options->backend != BACKEND_POINTER && (options->heap != HEAP_BINARY || has_buckets)) {
+        fprintf(stderr, "--heap 4ary|bucket and --buckets require --tree pointer\n");
+        return false;
+    }
+
+    if (options->tile > 0 && options->backend != BACKEND_POINTER) {
+        fprintf(stderr, "--tile requires --tree pointer\n");
+        return false;
+    }
+
+    // smaller tiles could never be split at all
+    if (options->tile > 0 && options->tile < 2 * (uint64_t)options->min_leaf) {
+        fprintf(stderr, "--tile must be at least twice --min-leaf\n");
+        return false;
+    }
+
+    if (!has_splits) {
+        options->splits = options->error > 0 ? SIZE_MAX : 1000;
+    }
+
+    return true;
+}
+
+SessionConfig options_session_config(const Options *options) {
+    return (SessionConfig) {
+        .depth = options->depth,
+        .heap = options->heap,
+        .buckets = options->buckets,
+        .score = options->score,
+        .min_leaf = options->min_leaf
+    };
+}
+
+ImageConfig options_image_config(const Options *options) {
+    return (ImageConfig) {
+        .stats = options->stats,
+        .integral = options->integral,
+        .decoder = options->decoder,
+        .layout = options->layout,
+        .pyramid = options->pyramid
+    };
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "decoder.h"
+#include "heap.h"
+#include "image.h"
+#include "quad.h"
+#include "score.h"
+#include "session.h"
+
+// how the quadtree is stored
+typedef enum {
+    BACKEND_POINTER, // Quad nodes linked through arena allocated Children
+    BACKEND_SOA, // index based structure of arrays, see tree.h
+    BACKEND_LINEAR, // Morton keyed hash map without child links, see linear.h
+} TreeBackend;
+
+// how the viewer paces its main loop
+typedef enum {
+    RENDER_WAIT, // sleep in SDL_WaitEvent, render only after splits or window events
+    RENDER_VSYNC, // present every display refresh, rendering only what changed
+    RENDER_POLL, // poll for events and present as fast as possible
+} RenderMode;
+
+typedef struct {
+    // image path, or in batch mode a directory or a file listing one image per line
+    const char *input;
+    // output file, or in batch mode the output directory
+    const char *output;
+    bool headless;
+    bool batch;
+    bool bench;
+    size_t threads;
+    const char *format;
+    bool integral;
+    StatsMode stats;
+    DecoderKind decoder;
+    // pixel layout for the scanning stats modes, unused with integral tables
+    PixelLayout layout;
+    // build the cell moments mip chain, for scanning stats and the viewer preview
+    bool pyramid;
+    TreeBackend backend;
+    RenderMode render;
+    // viewer: time spent splitting every frame without key presses, 0 when off
+    uint64_t auto_refine_ns;
+    HeapKind heap;
+    size_t buckets;
+    ScoreKind score;
+    uint32_t min_leaf;
+    // headless: side of the square tiles refined separately, 0 for one tree
+    uint32_t tile;
+    uint32_t depth;
+    size_t splits;
+    float error;
+} Options;
+
+// Fills `options` from the command line, reporting the first invalid argument.
+bool options_parse(Options *options, int argc, char **argv);
+void options_usage(FILE *file, const char *program);
+SessionConfig options_session_config(const Options *options);
+ImageConfig options_image_config(const Options *options);
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+// Runs tasks of the current batch until none are left. Called with the mutex held.
+static void pool_work(Pool *pool) {
+    while (pool->next < pool->count) {
+        size_t index = pool->next++;
+
+        pthread_mutex_unlock(&pool->mutex);
+        pool->task(pool->context, index);
+        pthread_mutex_lock(&pool->mutex);
+
+        pool->pending--;
+        if (pool->pending == 0) {
+            pthread_cond_broadcast(&pool->work_done);
+        }
+    }
+}
+
+static void *pool_worker(void *arg) {
+    Pool *pool = arg;
+    uint64_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (true) {
+        while (!pool->stop && pool->generation == generation) {
+            pthread_cond_wait(&pool->work_ready, &pool->mutex);
+        }
+        if (pool->stop) {
+            break;
+        }
+
+        generation = pool->generation;
+        pool_work(pool);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return nullptr;
+}
+
+bool pool_init(Pool *pool, size_t threads) {
+    *pool = (Pool) {0};
+    pthread_mutex_init(&pool->mutex, nullptr);
+    pthread_cond_init(&pool->work_ready, nullptr);
+    pthread_cond_init(&pool->work_done, nullptr);
+
+    if (threads <= 1) {
+        return true;
+    }
+
+    pool->threads = malloc(sizeof(pthread_t) * (threads - 1));
+    if (!pool->threads) {
+        fprintf(stderr, "Failed to malloc thread pool\n");
+        pool_deinit(pool);
+        return false;
+    }
+
+    for (size_t i = 0; i < threads - 1; i++) {
+        if (pthread_create(&pool->threads[i], nullptr, pool_worker, pool) != 0) {
+            fprintf(stderr, "Failed to create worker thread\n");
+            pool_deinit(pool);
+            return false;
+        }
+        pool->thread_count++;
+    }
+
+    return true;
+}
+
+void pool_deinit(Pool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], nullptr);
+    }
+    free(pool->threads);
+    pool->threads = nullptr;
+    pool->thread_count = 0;
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+void pool_run(Pool *pool, PoolTask task, void *context, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->count = count;
+    pool->next = 0;
+    pool->pending = count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    pool_work(pool);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+size_t pool_default_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+}
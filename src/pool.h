@@ -0,0 +1,33 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*PoolTask)(void *context, size_t index);
+
+// A fixed set of worker threads that run batches of indexed tasks. The thread
+// calling pool_run works on the batch too and returns once every task is done.
+typedef struct {
+    pthread_t *threads;
+    size_t thread_count;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+
+    PoolTask task;
+    void *context;
+    size_t count;
+    size_t next;
+    size_t pending;
+    uint64_t generation;
+    bool stop;
+} Pool;
+
+// `threads` counts the caller, so a pool of 1 spawns no threads at all
+bool pool_init(Pool *pool, size_t threads);
+void pool_deinit(Pool *pool);
+void pool_run(Pool *pool, PoolTask task, void *context, size_t count);
+
+size_t pool_default_threads(void);
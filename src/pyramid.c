@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "moments.h"
+#include "pyramid.h"
+
+uint32_t pyramid_cell_size(uint32_t level) {
+    return 1u << (PYRAMID_BASE + level);
+}
+
+static bool pyramid_level_init(PyramidLevel *level, uint64_t columns, uint64_t rows) {
+    level->columns = columns;
+    level->rows = rows;
+    level->cells = calloc(columns * rows, sizeof(Moments));
+    if (!level->cells) {
+        fprintf(stderr, "Failed to malloc image pyramid\n");
+        return false;
+    }
+    return true;
+}
+
+bool pyramid_init(Pyramid *pyramid, const Image *image) {
+    uint32_t size = image->width > image->height ? image->width : image->height;
+
+    // one level per halving until a single cell covers the image
+    pyramid->count = 1;
+    while (pyramid_cell_size(pyramid->count - 1) < size) {
+        pyramid->count++;
+    }
+
+    pyramid->levels = calloc(pyramid->count, sizeof(PyramidLevel));
+    if (!pyramid->levels) {
+        fprintf(stderr, "Failed to malloc image pyramid\n");
+        return false;
+    }
+
+    uint32_t cell = pyramid_cell_size(0);
+    PyramidLevel *base = &pyramid->levels[0];
+    if (!pyramid_level_init(base, ((uint64_t)image->width + cell - 1) / cell, ((uint64_t)image->height + cell - 1) / cell)) {
+        pyramid_deinit(pyramid);
+        return false;
+    }
+
+    for (uint32_t row = 0; row < base->rows; row++) {
+        for (uint32_t column = 0; column < base->columns; column++) {
+            Box box = {
+                .left = column * cell,
+                .right = (column + 1) * cell < (uint32_t)image->width ? (column + 1) * cell : (uint32_t)image->width,
+                .top = row * cell,
+                .bottom = (row + 1) * cell < (uint32_t)image->height ? (row + 1) * cell : (uint32_t)image->height
+            };
+            base->cells[(size_t)row * base->columns + column] = box_moments(image, &box);
+        }
+    }
+
+    for (uint32_t i = 1; i < pyramid->count; i++) {
+        const PyramidLevel *below = &pyramid->levels[i - 1];
+        PyramidLevel *level = &pyramid->levels[i];
+        if (!pyramid_level_init(level, (below->columns + 1) / 2, (below->rows + 1) / 2)) {
+            pyramid_deinit(pyramid);
+            return false;
+        }
+
+        for (uint32_t row = 0; row < below->rows; row++) {
+            for (uint32_t column = 0; column < below->columns; column++) {
+                moments_merge(&level->cells[(size_t)(row / 2) * level->columns + column / 2], &below->cells[(size_t)row * below->columns + column]);
+            }
+        }
+    }
+
+    return true;
+}
+
+void pyramid_deinit(Pyramid *pyramid) {
+    if (pyramid->levels) {
+        for (uint32_t i = 0; i < pyramid->count; i++) {
+            free(pyramid->levels[i].cells);
+        }
+    }
+    free(pyramid->levels);
+    pyramid->levels = nullptr;
+    pyramid->count = 0;
+}
+
+// an edge lines up with a level when it is on a cell boundary or the image edge
+static bool pyramid_aligned(uint32_t edge, uint32_t cell, uint32_t limit) {
+    return edge % cell == 0 || edge == limit;
+}
+
+// sums the cells [left, right) x [top, bottom) of a level
+static void pyramid_sum(const PyramidLevel *level, uint32_t left, uint32_t right, uint32_t top, uint32_t bottom, Moments *moments) {
+    for (uint32_t row = top; row < bottom; row++) {
+        const Moments *cells = &level->cells[(size_t)row * level->columns];
+        for (uint32_t column = left; column < right; column++) {
+            moments_merge(moments, &cells[column]);
+        }
+    }
+}
+
+static void pyramid_scan(const Image *image, uint32_t left, uint32_t right, uint32_t top, uint32_t bottom, Moments *moments) {
+    if (left >= right || top >= bottom) {
+        return;
+    }
+
+    Moments strip = box_scan(image, &(Box) { .left = left, .right = right, .top = top, .bottom = bottom });
+    moments_merge(moments, &strip);
+}
+
+Moments pyramid_moments(const Pyramid *pyramid, const Image *image, const Box *box) {
+    uint32_t width = image->width;
+    uint32_t height = image->height;
+    Moments moments = {0};
+
+    for (uint32_t i = pyramid->count; i-- > 0;) {
+        uint32_t cell = pyramid_cell_size(i);
+        if (pyramid_aligned(box->left, cell, width) && pyramid_aligned(box->right, cell, width)
+            && pyramid_aligned(box->top, cell, height) && pyramid_aligned(box->bottom, cell, height)) {
+            pyramid_sum(
+                &pyramid->levels[i],
+                box->left / cell, (box->right + cell - 1) / cell,
+                box->top / cell, (box->bottom + cell - 1) / cell,
+                &moments
+            );
+            return moments;
+        }
+    }
+
+    // the finest cells fully inside the box, a cut off edge cell counts as inside
+    uint32_t cell = pyramid_cell_size(0);
+    const PyramidLevel *base = &pyramid->levels[0];
+    uint32_t left = (box->left + cell - 1) / cell;
+    uint32_t top = (box->top + cell - 1) / cell;
+    uint32_t right = box->right == width ? base->columns : box->right / cell;
+    uint32_t bottom = box->bottom == height ? base->rows : box->bottom / cell;
+    if (left >= right || top >= bottom) {
+        return box_scan(image, box);
+    }
+
+    uint32_t inner_left = left * cell;
+    uint32_t inner_top = top * cell;
+    uint32_t inner_right = box->right == width ? width : right * cell;
+    uint32_t inner_bottom = box->bottom == height ? height : bottom * cell;
+
+    pyramid_sum(base, left, right, top, bottom, &moments);
+    pyramid_scan(image, box->left, box->right, box->top, inner_top, &moments);
+    pyramid_scan(image, box->left, box->right, inner_bottom, box->bottom, &moments);
+    pyramid_scan(image, box->left, inner_left, inner_top, inner_bottom, &moments);
+    pyramid_scan(image, inner_right, box->right, inner_top, inner_bottom, &moments);
+
+    return moments;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "quad.h"
+
+// cells of the finest level are 2^PYRAMID_BASE pixels wide, wide enough for the
+// vectorized scans to build them and small enough to cover most boxes
+#define PYRAMID_BASE 4
+
+typedef struct {
+    // row-major, cells on the right and bottom edge may be cut off by the image
+    Moments *cells;
+    uint32_t columns;
+    uint32_t rows;
+} PyramidLevel;
+
+// Mip chain of per cell moments: level i holds one cell per 2^(PYRAMID_BASE + i)
+// square block of the image, every level above the first merging 2x2 cells of
+// the one below, up to a single cell for the whole image.
+typedef struct Pyramid {
+    PyramidLevel *levels;
+    uint32_t count;
+} Pyramid;
+
+// builds every level from the image's statistics source, the image must not have
+// a pyramid yet
+bool pyramid_init(Pyramid *pyramid, const Image *image);
+void pyramid_deinit(Pyramid *pyramid);
+
+uint32_t pyramid_cell_size(uint32_t level);
+
+// Moments of `box` from the coarsest level whose cell grid it lines up with.
+// Boxes that line up with no level take the aligned inside from the finest level
+// and scan only the strips around it.
+Moments pyramid_moments(const Pyramid *pyramid, const Image *image, const Box *box);
@@ -1,57 +1,106 @@
 #include "quad.h"
+#include "histogram.h"
+#include "integral.h"
+#include "moments.h"
+#include "pyramid.h"
 #include <math.h>
 #include <stddef.h>
 #include <stdint.h>
-#include <stdlib.h>
+#include <string.h>
 
-static uint64_t box_area(Box *box) {
-    return (box->right - box->left) * (box->bottom - box->top);
+// widened before multiplying, boxes of gigapixel images overflow 32 bits
+static uint64_t box_area(const Box *box) {
+    return (uint64_t)(box->right - box->left) * (box->bottom - box->top);
 }
 
-static void calculate_histogram(const Image *image, const Box *box, uint32_t histogram[static 768]) {
+// measured crossover, between 16x16 and 32x32 boxes both cost about the same
+#define HISTOGRAM_SPLIT_PIXELS 512
+
+// Counts the three planes in step, one counter each as for packed pixels. Boxes
+// of at least HISTOGRAM_SPLIT_PIXELS pixels count odd columns into a second copy
+// of the histogram, so runs of equal values (the common case inside a quad) do
+// not serialize on one counter; below that clearing and adding it costs more
+// than it saves.
+static void calculate_histogram_planar(const Image *image, const Box *box, uint32_t histogram[static 768]) {
+    size_t width = box->right - box->left;
+
+    uint32_t counts[768];
+    uint32_t *odd = histogram;
+    if (box_area(box) >= HISTOGRAM_SPLIT_PIXELS) {
+        memset(counts, 0, sizeof(counts));
+        odd = counts;
+    }
+
     for (uint32_t row = box->top; row < box->bottom; row++) {
-        for (uint32_t column = box->left; column < box->right; column++) {
-            uint8_t red = image->data[row * image->width * 3 + column * 3 + 0];
-            uint8_t green = image->data[row * image->width * 3 + column * 3 + 1];
-            uint8_t blue = image->data[row * image->width * 3 + column * 3 + 2];
+        const uint8_t *red = &image->data[(size_t)row * image->stride + box->left];
+        const uint8_t *green = red + image->plane;
+        const uint8_t *blue = green + image->plane;
+
+        size_t column = 0;
+        for (; column + 2 <= width; column += 2) {
+            histogram[0 + red[column]]++;
+            histogram[256 + green[column]]++;
+            histogram[512 + blue[column]]++;
+            odd[0 + red[column + 1]]++;
+            odd[256 + green[column + 1]]++;
+            odd[512 + blue[column + 1]]++;
+        }
+        if (column < width) {
+            histogram[0 + red[column]]++;
+            histogram[256 + green[column]]++;
+            histogram[512 + blue[column]]++;
+        }
+    }
 
-            histogram[0 + red]++; // 0 - 255
-            histogram[256 + green]++; // 256 - 511
-            histogram[512 + blue]++; // 512 - 768
+    if (odd != histogram) {
+        for (size_t value = 0; value < 768; value++) {
+            histogram[value] += counts[value];
         }
     }
 }
 
-static WeightedColor weighted_color(const uint32_t histogram[static 256]) {
-    uint64_t total = 0;
-    for (size_t i = 0; i < 256; i++) {
-        total += histogram[i];
+static void calculate_histogram(const Image *image, const Box *box, uint32_t histogram[static 768]) {
+    size_t width = box->right - box->left;
+
+    if (image->layout == LAYOUT_PLANAR) {
+        calculate_histogram_planar(image, box, histogram);
+        return;
     }
 
-    float mean = 0;
-    for (size_t i = 0; i < 256; i++) {
-        mean += histogram[i] * i;
+    size_t bytes = image->layout == LAYOUT_RGBX ? 4 : 3;
+    for (uint32_t row = box->top; row < box->bottom; row++) {
+        const uint8_t *pixels = &image->data[(size_t)row * image->stride + box->left * bytes];
+
+        for (size_t column = 0; column < width; column++) {
+            uint8_t red = pixels[column * bytes + 0];
+            uint8_t green = pixels[column * bytes + 1];
+            uint8_t blue = pixels[column * bytes + 2];
+
+            histogram[0 + red]++; // 0 - 255
+            histogram[256 + green]++; // 256 - 511
+            histogram[512 + blue]++; // 512 - 768
+        }
     }
-    mean /= total;
+}
 
-    float variance = 0;
-    for (size_t i = 0; i < 256; i++) {
-        float diff = i - mean;
-        variance += histogram[i] * diff * diff;
+static WeightedColor weighted_color_from_moments(uint64_t count, uint64_t sum, uint64_t sum_sq) {
+    if (count == 0) {
+        return (WeightedColor) {0};
     }
 
-    variance /= total;
+    double mean = (double)sum / count;
+    double variance = (double)sum_sq / count - mean * mean;
 
     return (WeightedColor) {
         .value = mean,
-        .error = sqrt(variance)
+        .error = variance > 0 ? sqrt(variance) : 0
     };
 }
 
-static AverageColor color_from_histogram(const uint32_t histogram[static 768]) {
-    WeightedColor red = weighted_color(&histogram[0]);
-    WeightedColor green = weighted_color(&histogram[256]);
-    WeightedColor blue = weighted_color(&histogram[512]);
+AverageColor color_from_moments(const Moments *moments) {
+    WeightedColor red = weighted_color_from_moments(moments->count, moments->sum[0], moments->sum_sq[0]);
+    WeightedColor green = weighted_color_from_moments(moments->count, moments->sum[1], moments->sum_sq[1]);
+    WeightedColor blue = weighted_color_from_moments(moments->count, moments->sum[2], moments->sum_sq[2]);
 
     float error = 0.299 * red.error + 0.587 * green.error + 0.114 * blue.error;
 
@@ -65,6 +114,45 @@ static AverageColor color_from_histogram(const uint32_t histogram[static 768]) {
     };
 }
 
+Moments box_moments(const Image *image, const Box *box) {
+    if (image->integral) {
+        return integral_moments(image->integral, box);
+    }
+
+    if (image->pyramid) {
+        return pyramid_moments(image->pyramid, image, box);
+    }
+
+    return box_scan(image, box);
+}
+
+Moments box_scan(const Image *image, const Box *box) {
+    if (image->stats == STATS_HISTOGRAM) {
+        uint32_t histogram[256 * 3] = {0};
+        calculate_histogram(image, box, histogram);
+        return histogram_moments(histogram);
+    }
+
+    return moments_scan(image, box);
+}
+
+// a min_leaf of 1 still rules out boxes narrower than 2 pixels, whose children
+// would be empty
+bool box_can_split_to(const Box *box, uint32_t min_leaf) {
+    uint64_t side = 2 * (uint64_t)min_leaf;
+    return box->right - box->left >= side && box->bottom - box->top >= side;
+}
+
+void box_split(const Box *box, Box children[static 4]) {
+    uint32_t mlr = box->left + (box->right - box->left) / 2;
+    uint32_t mtb = box->top + (box->bottom - box->top) / 2;
+
+    children[0] = (Box) { .left = box->left, .right = mlr, .top = box->top, .bottom = mtb };
+    children[1] = (Box) { .left = mlr, .right = box->right, .top = box->top, .bottom = mtb };
+    children[2] = (Box) { .left = box->left, .right = mlr, .top = mtb, .bottom = box->bottom };
+    children[3] = (Box) { .left = mlr, .right = box->right, .top = mtb, .bottom = box->bottom };
+}
+
 Quad quad_init(const Image *image, uint32_t left, uint32_t right, uint32_t top, uint32_t bottom) {
     Box box = (Box) {
         .left = left,
@@ -78,9 +166,8 @@ Quad quad_init(const Image *image, uint32_t left, uint32_t right, uint32_t top,
         .area = box_area(&box)
     };
 
-    uint32_t histogram[256 * 3] = {0};
-    calculate_histogram(image, &box, histogram);
-    AverageColor average_color = color_from_histogram(histogram);
+    Moments moments = box_moments(image, &box);
+    AverageColor average_color = color_from_moments(&moments);
 
     return (Quad) {
         .image = image,
@@ -94,18 +181,70 @@ Quad quad_init_from_image(const Image *image) {
     return quad_init(image, 0, image->width, 0, image->height);
 }
 
-Children* quad_split(Quad *quad) {
-    quad->children = malloc(sizeof(Children));
-    // TODO: error checking
+// Builds the subtree of `box` down to `depth` levels. Only the deepest quads read
+// pixels, every parent merges the moments of its four children, so each pixel is
+// visited exactly once no matter how deep the tree goes. When the arena runs out
+// the quad stays a leaf, so the tree is always complete.
+static bool quad_build(Quad *quad, const Image *image, Box box, uint32_t depth, uint32_t min_leaf, Arena *arena, Moments *moments) {
+    *quad = (Quad) {
+        .image = image,
+        .boundary = (Boundary) {
+            .box = box,
+            .area = box_area(&box)
+        },
+        .children = nullptr
+    };
+
+    bool ok = true;
+    if (depth > 0 && box_can_split_to(&box, min_leaf)) {
+        quad->children = arena_alloc(arena, sizeof(Children));
+        ok = quad->children != nullptr;
+    }
+
+    if (!quad->children) {
+        *moments = box_moments(image, &box);
+        quad->average_color = color_from_moments(moments);
+        return ok;
+    }
+
+    Box boxes[4];
+    box_split(&box, boxes);
+
+    Moments child;
+    *moments = (Moments) {0};
+
+    ok = quad_build(&quad->children->top_left, image, boxes[0], depth - 1, min_leaf, arena, &child) && ok;
+    moments_merge(moments, &child);
+    ok = quad_build(&quad->children->top_right, image, boxes[1], depth - 1, min_leaf, arena, &child) && ok;
+    moments_merge(moments, &child);
+    ok = quad_build(&quad->children->bottom_left, image, boxes[2], depth - 1, min_leaf, arena, &child) && ok;
+    moments_merge(moments, &child);
+    ok = quad_build(&quad->children->bottom_right, image, boxes[3], depth - 1, min_leaf, arena, &child) && ok;
+    moments_merge(moments, &child);
+
+    quad->average_color = color_from_moments(moments);
+    return ok;
+}
+
+bool quad_init_region(Quad *quad, const Image *image, const Box *box, uint32_t depth, uint32_t min_leaf, Arena *arena) {
+    Moments moments;
+    return quad_build(quad, image, *box, depth, min_leaf, arena, &moments);
+}
+
+Children* quad_split(Quad *quad, Arena *arena) {
+    Children *children = arena_alloc(arena, sizeof(Children));
+    if (!children) {
+        return nullptr;
+    }
+    quad->children = children;
 
-    Box box = quad->boundary.box;
-    uint32_t mlr = box.left + (box.right - box.left) / 2;
-    uint32_t mtb = box.top + (box.bottom - box.top) / 2;
+    Box boxes[4];
+    box_split(&quad->boundary.box, boxes);
 
-    quad->children->top_left = quad_init(quad->image, box.left, mlr, box.top, mtb);
-    quad->children->top_right = quad_init(quad->image, mlr, box.right, box.top, mtb);
-    quad->children->bottom_left = quad_init(quad->image, box.left, mlr, mtb, box.bottom);
-    quad->children->bottom_right = quad_init(quad->image, mlr, box.right, mtb, box.bottom);
+    quad->children->top_left = quad_init(quad->image, boxes[0].left, boxes[0].right, boxes[0].top, boxes[0].bottom);
+    quad->children->top_right = quad_init(quad->image, boxes[1].left, boxes[1].right, boxes[1].top, boxes[1].bottom);
+    quad->children->bottom_left = quad_init(quad->image, boxes[2].left, boxes[2].right, boxes[2].top, boxes[2].bottom);
+    quad->children->bottom_right = quad_init(quad->image, boxes[3].left, boxes[3].right, boxes[3].top, boxes[3].bottom);
 
     return quad->children;
 }
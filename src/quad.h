@@ -2,10 +2,38 @@
 
 #include <stdint.h>
 
+#include "arena.h"
+
+struct IntegralImage;
+struct Pyramid;
+
+// how quad statistics are gathered from raw pixels when there are no tables
+typedef enum {
+    STATS_MOMENTS, // count, sum and sum of squares per channel
+    STATS_HISTOGRAM, // full 768 bin histogram, kept for median/percentile metrics
+} StatsMode;
+
+// how Image.data stores its pixels
+typedef enum {
+    LAYOUT_RGB, // 3 bytes per pixel, packed rows
+    LAYOUT_RGBX, // 4 bytes per pixel with a zero pad byte, rows start on a cache line
+    LAYOUT_PLANAR, // a plane of bytes per channel, rows start on a cache line
+} PixelLayout;
+
 typedef struct {
+    // pixels in `layout`, nullptr when the statistics come from `integral` alone
     uint8_t *data;
     int width;
     int height;
+    PixelLayout layout;
+    // bytes from one row to the next, and for LAYOUT_PLANAR from one plane to the next
+    size_t stride;
+    size_t plane;
+    StatsMode stats;
+    // optional summed-area tables, when set quad statistics are read from here
+    struct IntegralImage *integral;
+    // optional mip chain of cell moments, used for boxes when there are no tables
+    struct Pyramid *pyramid;
 } Image;
 
 typedef struct {
@@ -33,6 +61,13 @@ typedef struct {
     float error;
 } AverageColor;
 
+// per channel (red, green, blue) pixel count, sum and sum of squares
+typedef struct {
+    uint64_t count;
+    uint64_t sum[3];
+    uint64_t sum_sq[3];
+} Moments;
+
 struct Children;
 typedef struct Children Children;
 
@@ -50,5 +85,22 @@ typedef struct Children {
     Quad bottom_right;
 } Children;
 
+// statistics of a box from the fastest source the image provides
+Moments box_moments(const Image *image, const Box *box);
+// statistics straight from the pixels, ignoring the tables and the pyramid
+Moments box_scan(const Image *image, const Box *box);
+AverageColor color_from_moments(const Moments *moments);
+
+// whether splitting leaves every child at least `min_leaf` pixels on each side
+bool box_can_split_to(const Box *box, uint32_t min_leaf);
+// children in top left, top right, bottom left, bottom right order
+void box_split(const Box *box, Box children[static 4]);
+
 Quad quad_init_from_image(const Image *image);
-Children* quad_split(Quad *quad);
+// Builds the tree over the part of the image inside `box` down to `depth`
+// bottom-up, never leaving a child under `min_leaf` pixels per side, children
+// come from `arena`. Returns false if the arena ran out, the quads that could
+// not be split stay leaves.
+bool quad_init_region(Quad *quad, const Image *image, const Box *box, uint32_t depth, uint32_t min_leaf, Arena *arena);
+// returns nullptr, leaving the quad untouched, when the arena is out of memory
+Children* quad_split(Quad *quad, Arena *arena);
@@ -0,0 +1,214 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fill.h"
+#include "render.h"
+#include "stb_ds.h"
+
+const uint32_t PADDING = 1;
+
+bool framebuffer_init(Framebuffer *framebuffer, uint32_t width, uint32_t height) {
+    framebuffer->width = width;
+    framebuffer->height = height;
+
+    framebuffer->data = malloc(sizeof(uint32_t) * height * width);
+    if (!framebuffer->data) {
+        fprintf(stderr, "Failed to malloc framebuffer data\n");
+        return false;
+    }
+
+    return true;
+}
+
+void framebuffer_deinit(Framebuffer *framebuffer) {
+    free(framebuffer->data);
+    framebuffer->data = nullptr;
+}
+
+void draw_rectangle(Framebuffer *framebuffer, uint32_t left, uint32_t top, uint32_t width, uint32_t height, uint32_t color) {
+    uint32_t *data = &framebuffer->data[(size_t)top * framebuffer->width + left];
+
+    if (width == framebuffer->width) {
+        fill_rows(data, width, height, color);
+    } else {
+        fill_rect(data, framebuffer->width, width, height, color);
+    }
+}
+
+static uint32_t pack_color(Color color) {
+    return (0xFF << 24) | (color.red << 16) | (color.green << 8) | (color.blue);
+}
+
+// draws the box clipped to the framebuffer rows [top, bottom)
+static void draw_box_rows(Framebuffer *framebuffer, const Box *box, uint32_t color, uint32_t top, uint32_t bottom) {
+    uint32_t first = box->top + PADDING > top ? box->top + PADDING : top;
+    uint32_t last = box->bottom < bottom ? box->bottom : bottom;
+    if (first >= last) {
+        return;
+    }
+
+    draw_rectangle(framebuffer, box->left + PADDING, first, box->right - box->left - PADDING, last - first, color);
+}
+
+static void draw_box(Framebuffer *framebuffer, const Box *box, uint32_t color) {
+    draw_box_rows(framebuffer, box, color, 0, framebuffer->height);
+}
+
+static void render_quad(Framebuffer *framebuffer, const Quad *quad) {
+    if (quad->children) {
+        render_quad(framebuffer, &quad->children->top_left);
+        render_quad(framebuffer, &quad->children->top_right);
+        render_quad(framebuffer, &quad->children->bottom_left);
+        render_quad(framebuffer, &quad->children->bottom_right);
+        return;
+    }
+
+    draw_box(framebuffer, &quad->boundary.box, pack_color(quad->average_color.color));
+}
+
+// Bands are at least this many rows high, smaller ones cost more in traversals of
+// the upper levels than they gain in balance.
+#define RENDER_BAND_MIN_ROWS 64
+
+typedef struct {
+    Framebuffer *framebuffer;
+    const Quad *root;
+    const Tree *tree;
+    uint32_t band_height;
+} RenderTask;
+
+// only descends into quads overlapping the rows, every quad covers its children
+static void render_quad_rows(Framebuffer *framebuffer, const Quad *quad, uint32_t top, uint32_t bottom) {
+    const Box *box = &quad->boundary.box;
+    if (box->bottom <= top || box->top + PADDING >= bottom) {
+        return;
+    }
+
+    if (quad->children) {
+        render_quad_rows(framebuffer, &quad->children->top_left, top, bottom);
+        render_quad_rows(framebuffer, &quad->children->top_right, top, bottom);
+        render_quad_rows(framebuffer, &quad->children->bottom_left, top, bottom);
+        render_quad_rows(framebuffer, &quad->children->bottom_right, top, bottom);
+        return;
+    }
+
+    draw_box_rows(framebuffer, box, pack_color(quad->average_color.color), top, bottom);
+}
+
+static void render_tree_rows(Framebuffer *framebuffer, const Tree *tree, uint32_t node, uint32_t top, uint32_t bottom) {
+    const Box *box = &tree->boxes[node];
+    if (box->bottom <= top || box->top + PADDING >= bottom) {
+        return;
+    }
+
+    uint32_t first = tree->first_child[node];
+    if (first != TREE_NONE) {
+        for (uint32_t i = 0; i < 4; i++) {
+            render_tree_rows(framebuffer, tree, first + i, top, bottom);
+        }
+        return;
+    }
+
+    draw_box_rows(framebuffer, box, pack_color(tree->colors[node]), top, bottom);
+}
+
+// Each band clears and draws only its own rows, so bands never write the same
+// pixels and need no locking.
+static void render_band(void *context, size_t index) {
+    const RenderTask *bands = context;
+    Framebuffer *framebuffer = bands->framebuffer;
+
+    uint32_t top = index * bands->band_height;
+    uint32_t bottom = top + bands->band_height < framebuffer->height ? top + bands->band_height : framebuffer->height;
+
+    draw_rectangle(framebuffer, 0, top, framebuffer->width, bottom - top, 0xFF000000);
+    if (bands->root) {
+        render_quad_rows(framebuffer, bands->root, top, bottom);
+    } else {
+        render_tree_rows(framebuffer, bands->tree, 0, top, bottom);
+    }
+}
+
+static void render_bands(Framebuffer *framebuffer, const Quad *root, const Tree *tree, Pool *pool) {
+    // a few bands per thread, the caller included, so a band full of small quads
+    // does not hold up the rest
+    size_t target = (pool->thread_count + 1) * 4;
+    uint32_t band_height = (framebuffer->height + target - 1) / target;
+    if (band_height < RENDER_BAND_MIN_ROWS) {
+        band_height = RENDER_BAND_MIN_ROWS;
+    }
+
+    RenderTask bands = {
+        .framebuffer = framebuffer,
+        .root = root,
+        .tree = tree,
+        .band_height = band_height
+    };
+    pool_run(pool, render_band, &bands, (framebuffer->height + band_height - 1) / band_height);
+}
+
+void render_quads(Framebuffer *framebuffer, const Quad *root, Pool *pool) {
+    if (pool) {
+        render_bands(framebuffer, root, nullptr, pool);
+        return;
+    }
+
+    // clear framebuffer with black
+    draw_rectangle(framebuffer, 0, 0, framebuffer->width, framebuffer->height, 0xFF000000);
+
+    render_quad(framebuffer, root);
+}
+
+void render_split(Framebuffer *framebuffer, const Quad *quad) {
+    // the children's top and left grid lines lie inside the parent's box
+    draw_box(framebuffer, &quad->boundary.box, 0xFF000000);
+
+    render_quad(framebuffer, quad);
+}
+
+void render_tree(Framebuffer *framebuffer, const Tree *tree, Pool *pool) {
+    if (pool) {
+        render_bands(framebuffer, nullptr, tree, pool);
+        return;
+    }
+
+    draw_rectangle(framebuffer, 0, 0, framebuffer->width, framebuffer->height, 0xFF000000);
+
+    for (uint32_t node = 0; node < tree->length; node++) {
+        if (tree->first_child[node] == TREE_NONE) {
+            draw_box(framebuffer, &tree->boxes[node], pack_color(tree->colors[node]));
+        }
+    }
+}
+
+void render_linear(Framebuffer *framebuffer, const LinearTree *tree) {
+    draw_rectangle(framebuffer, 0, 0, framebuffer->width, framebuffer->height, 0xFF000000);
+
+    for (ptrdiff_t i = 0; i < hmlen(tree->nodes); i++) {
+        const LinearNode *node = &tree->nodes[i];
+        if (linear_is_leaf(tree, node->key)) {
+            Box box = linear_box(tree, node->key);
+            draw_box(framebuffer, &box, pack_color(node->value.color));
+        }
+    }
+}
+
+void render_pyramid(Framebuffer *framebuffer, const Pyramid *pyramid, uint32_t level) {
+    const PyramidLevel *cells = &pyramid->levels[level];
+    uint32_t size = pyramid_cell_size(level);
+
+    for (uint32_t row = 0; row < cells->rows; row++) {
+        uint32_t top = row * size;
+        uint32_t height = framebuffer->height - top < size ? framebuffer->height - top : size;
+
+        for (uint32_t column = 0; column < cells->columns; column++) {
+            uint32_t left = column * size;
+            uint32_t width = framebuffer->width - left < size ? framebuffer->width - left : size;
+
+            AverageColor color = color_from_moments(&cells->cells[(size_t)row * cells->columns + column]);
+            draw_rectangle(framebuffer, left, top, width, height, pack_color(color.color));
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "linear.h"
+#include "pool.h"
+#include "pyramid.h"
+#include "quad.h"
+#include "tree.h"
+
+extern const uint32_t PADDING;
+
+typedef struct Framebuffer {
+    uint32_t *data;
+    uint32_t width;
+    uint32_t height;
+} Framebuffer;
+
+bool framebuffer_init(Framebuffer *framebuffer, uint32_t width, uint32_t height);
+void framebuffer_deinit(Framebuffer *framebuffer);
+
+void draw_rectangle(Framebuffer *framebuffer, uint32_t left, uint32_t top, uint32_t width, uint32_t height, uint32_t color);
+
+// Clears the framebuffer and draws every leaf of the tree as a filled rectangle.
+// With a pool the framebuffer is split into horizontal bands rasterized in
+// parallel, each band clipping the quads to its rows; nullptr draws serially.
+void render_quads(Framebuffer *framebuffer, const Quad *root, Pool *pool);
+
+// Redraws only the box of a quad that was split since it was last drawn: clears
+// the inside of its box and draws the leaves below it, leaving the rest intact.
+void render_split(Framebuffer *framebuffer, const Quad *quad);
+
+// same for an index based tree, serially a single linear pass over its node arrays
+void render_tree(Framebuffer *framebuffer, const Tree *tree, Pool *pool);
+
+// and for a linear quadtree, walking its hash map
+void render_linear(Framebuffer *framebuffer, const LinearTree *tree);
+
+// Draws one level of the image pyramid as blocks of each cell's mean color, a
+// downsampled preview of the image that costs one fill per cell.
+void render_pyramid(Framebuffer *framebuffer, const Pyramid *pyramid, uint32_t level);
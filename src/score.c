@@ -0,0 +1,37 @@
+#include "score.h"
+
+// (1 + i / 64)^0.25, one entry past the end for interpolation
+static const float MANTISSA_ROOT4[65] = {
+    1.000000000f, 1.003883568f, 1.007722581f, 1.011518214f, 1.015271592f, 1.018983799f,
+    1.022655872f, 1.026288810f, 1.029883572f, 1.033441081f, 1.036962226f, 1.040447863f,
+    1.043898815f, 1.047315878f, 1.050699818f, 1.054051375f, 1.057371263f, 1.060660172f,
+    1.063918767f, 1.067147692f, 1.070347571f, 1.073519006f, 1.076662580f, 1.079778858f,
+    1.082868385f, 1.085931693f, 1.088969294f, 1.091981686f, 1.094969352f, 1.097932760f,
+    1.100872365f, 1.103788609f, 1.106681920f, 1.109552714f, 1.112401397f, 1.115228361f,
+    1.118033989f, 1.120818653f, 1.123582715f, 1.126326527f, 1.129050432f, 1.131754764f,
+    1.134439848f, 1.137105999f, 1.139753528f, 1.142382735f, 1.144993913f, 1.147587347f,
+    1.150163317f, 1.152722094f, 1.155263945f, 1.157789127f, 1.160297894f, 1.162790492f,
+    1.165267163f, 1.167728142f, 1.170173660f, 1.172603940f, 1.175019203f, 1.177419663f,
+    1.179805531f, 1.182177011f, 1.184534305f, 1.186877609f, 1.189207115f,
+};
+
+// 2^(k / 4)
+static const float QUARTER_ROOT4[4] = { 1.000000000f, 1.189207115f, 1.414213562f, 1.681792831f };
+
+float score_area_root4(uint64_t area) {
+    if (area == 0) {
+        return 0;
+    }
+
+    // area = 2^exponent * (1 + fraction), fraction as 32 bit fixed point
+    uint32_t exponent = 63 - __builtin_clzll(area);
+    uint32_t fraction = exponent >= 32 ? (uint32_t)(area >> (exponent - 32)) : (uint32_t)(area << (32 - exponent));
+
+    // the top 6 bits of the fraction pick the table entry, the rest interpolates
+    uint32_t index = fraction >> 26;
+    float t = (fraction & ((1u << 26) - 1)) * (1.0f / (1u << 26));
+    float root = MANTISSA_ROOT4[index] + (MANTISSA_ROOT4[index + 1] - MANTISSA_ROOT4[index]) * t;
+
+    // 2^(exponent / 4) split into a whole power of two and a quarter step
+    return root * (float)(1u << (exponent >> 2)) * QUARTER_ROOT4[exponent & 3];
+}
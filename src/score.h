@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#include "quad.h"
+
+// How a quad's error is weighted by its size (and colour) to rank it in the heap.
+typedef enum {
+    // error alone, small noisy boxes compete with large ones
+    SCORE_ERROR,
+    // error * area, total squared deviation, favours large boxes
+    SCORE_AREA,
+    // error * sqrt(area)
+    SCORE_SQRT_AREA,
+    // error * area^0.25, the default
+    SCORE_ROOT4_AREA,
+    // error * area^0.25 relative to the box's luma (Weber's law), so the same
+    // deviation counts for more in dark regions than in bright ones
+    SCORE_PERCEPTUAL,
+} ScoreKind;
+
+// area^0.25 from a table instead of libm pow, accurate to about 1e-5 relative
+float score_area_root4(uint64_t area);
+
+// Heap key of a quad, lower pops first: its weighted error negated. Quads too
+// small to split are never pushed, so there is no penalty for small boxes.
+// Callers that score many quads switch on the kind once and call this with a
+// constant, so each kind compiles to its own straight-line path.
+static inline float score_quad(const ScoreKind kind, float error, Color color, const Box *box) {
+    uint32_t width = box->right - box->left;
+    uint32_t height = box->bottom - box->top;
+    uint64_t area = (uint64_t)width * height;
+
+    float priority;
+    switch (kind) {
+        case SCORE_ERROR:
+            priority = error;
+            break;
+        case SCORE_AREA:
+            priority = error * (float)area;
+            break;
+        case SCORE_SQRT_AREA:
+            priority = error * sqrtf((float)area);
+            break;
+        case SCORE_PERCEPTUAL: {
+            // Rec. 709 luma in 8 bit fixed point, the offset keeps black finite
+            // and mid grey at a weight of about one
+            uint32_t luma = (54 * color.red + 183 * color.green + 19 * color.blue) >> 8;
+            priority = error * score_area_root4(area) * (128.0f / (float)(luma + 16));
+            break;
+        }
+        case SCORE_ROOT4_AREA:
+        default:
+            priority = error * score_area_root4(area);
+            break;
+    }
+
+    return -priority;
+}
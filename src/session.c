@@ -0,0 +1,142 @@
+#include <stdio.h>
+
+#include "clock.h"
+#include "session.h"
+#include "stb_ds.h"
+
+// splits between clock reads in session_refine_for, a few microseconds of work
+#define SESSION_REFINE_BATCH 32
+
+static bool session_can_split(const Session *session, const Quad *quad) {
+    return box_can_split_to(&quad->boundary.box, session->min_leaf);
+}
+
+static bool session_push_leaves(Session *session, Quad *quad) {
+    if (!quad->children) {
+        return !session_can_split(session, quad) || heap_push(&session->heap, quad);
+    }
+
+    return session_push_leaves(session, &quad->children->top_left)
+        && session_push_leaves(session, &quad->children->top_right)
+        && session_push_leaves(session, &quad->children->bottom_left)
+        && session_push_leaves(session, &quad->children->bottom_right);
+}
+
+bool session_init(Session *session, const Image *image, const SessionConfig *config) {
+    return session_init_region(session, image, &(Box) { 0, image->width, 0, image->height }, config);
+}
+
+bool session_init_region(Session *session, const Image *image, const Box *box, const SessionConfig *config) {
+    session->splits = 0;
+    session->dirty = nullptr;
+    session->track_dirty = config->track_dirty;
+    session->min_leaf = config->min_leaf > 0 ? config->min_leaf : 1;
+    session->out_of_memory = false;
+    arena_init(&session->arena);
+
+    if (config->heap == HEAP_BUCKET) {
+        if (!heap_init_buckets(&session->heap, config->buckets, config->score)) {
+            fprintf(stderr, "Failed to allocate %zu heap buckets\n", config->buckets);
+            return false;
+        }
+    } else {
+        heap_init(&session->heap, config->heap, config->score);
+    }
+
+    if (!quad_init_region(&session->root, image, box, config->depth, session->min_leaf, &session->arena)) {
+        fprintf(stderr, "Failed to allocate quads for depth %u\n", config->depth);
+        session_deinit(session);
+        return false;
+    }
+
+    if (!session_push_leaves(session, &session->root)) {
+        fprintf(stderr, "Failed to allocate heap\n");
+        session_deinit(session);
+        return false;
+    }
+
+    return true;
+}
+
+void session_deinit(Session *session) {
+    arrfree(session->dirty);
+    heap_deinit(&session->heap);
+    arena_deinit(&session->arena);
+}
+
+size_t session_refine(Session *session, size_t count, float error) {
+    size_t splits = 0;
+    while (splits < count && session->heap.length > 0 && !session->out_of_memory) {
+        // pops follow the score, not the error, so a quad below the threshold
+        // says nothing about the ones after it: it stays a leaf for good
+        Quad *quad = heap_pop(&session->heap);
+        if (quad->average_color.error < error) {
+            continue;
+        }
+
+        Children *children = quad_split(quad, &session->arena);
+        if (!children) {
+            fprintf(stderr, "Failed to allocate quads after %zu splits\n", session->splits + splits);
+            heap_push(&session->heap, quad);
+            session->out_of_memory = true;
+            break;
+        }
+
+        if (session->track_dirty) {
+            arrput(session->dirty, quad);
+        }
+
+        Quad *candidates[4] = { &children->top_left, &children->top_right, &children->bottom_left, &children->bottom_right };
+        Quad *quads[4];
+        size_t length = 0;
+        // children below the threshold would only be retired once popped, they
+        // are final leaves right away and a tile of them can finish early
+        for (size_t i = 0; i < 4; i++) {
+            if (session_can_split(session, candidates[i]) && candidates[i]->average_color.error >= error) {
+                quads[length++] = candidates[i];
+            }
+        }
+        if (!heap_push_many(&session->heap, quads, length)) {
+            fprintf(stderr, "Failed to grow heap after %zu splits\n", session->splits + splits);
+            session->out_of_memory = true;
+        }
+        splits++;
+    }
+
+    session->splits += splits;
+    return splits;
+}
+
+size_t session_refine_for(Session *session, uint64_t budget_ns, float error) {
+    uint64_t deadline = clock_now_ns() + budget_ns;
+
+    size_t splits = 0;
+    while (true) {
+        size_t batch = session_refine(session, SESSION_REFINE_BATCH, error);
+        splits += batch;
+        if (batch < SESSION_REFINE_BATCH || clock_now_ns() >= deadline) {
+            break;
+        }
+    }
+
+    return splits;
+}
+
+bool session_peek(Session *session, float error, float *score) {
+    while (session->heap.length > 0 && heap_top(&session->heap)->average_color.error < error) {
+        heap_pop(&session->heap);
+    }
+    if (session->heap.length == 0) {
+        return false;
+    }
+
+    *score = heap_top_score(&session->heap);
+    return true;
+}
+
+void session_clear_dirty(Session *session) {
+    // arrsetlen(..., 0) trips -Wtype-limits and arrdeln needs an allocated array
+    if (session->dirty) {
+        arrdeln(session->dirty, 0, arrlen(session->dirty));
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "heap.h"
+#include "quad.h"
+#include "score.h"
+
+typedef struct {
+    // > 0 builds the tree down to that depth bottom-up before refining
+    uint32_t depth;
+    HeapKind heap;
+    // HEAP_BUCKET only
+    size_t buckets;
+    ScoreKind score;
+    // quads are only split while every child keeps at least this many pixels
+    // per side, smaller ones are never queued
+    uint32_t min_leaf;
+    // record split quads in `dirty`, for a viewer redrawing only what changed
+    bool track_dirty;
+} SessionConfig;
+
+// One image being refined: the quadtree plus the heap of leaves that can still be
+// split. All children live in the session's arena and are released together in
+// session_deinit. The heap points into the tree, so a session must not be moved
+// once it has been initialized.
+typedef struct {
+    Quad root;
+    Heap heap;
+    Arena arena;
+    size_t splits;
+    // stb_ds array of the quads split since session_clear_dirty, for redrawing
+    // only what changed, stays empty unless the config asked to track them
+    Quad **dirty;
+    bool track_dirty;
+    uint32_t min_leaf;
+    // set once an allocation failed, refining stops at that point
+    bool out_of_memory;
+} Session;
+
+bool session_init(Session *session, const Image *image, const SessionConfig *config);
+// a session over just the part of the image inside `box`, used for tiles
+bool session_init_region(Session *session, const Image *image, const Box *box, const SessionConfig *config);
+void session_deinit(Session *session);
+
+// Splits the highest priority quads until `count` splits were made, no quad is
+// left to split or memory ran out. Popped quads with an error below `error` are
+// dropped from the heap as final leaves. Returns the number of splits performed.
+size_t session_refine(Session *session, size_t count, float error);
+// Like session_refine but splits for as long as `budget_ns` allows, checking the
+// clock every few splits. Returns the number of splits performed.
+size_t session_refine_for(Session *session, uint64_t budget_ns, float error);
+void session_clear_dirty(Session *session);
+// Drops the quads below `error` from the top of the heap as session_refine would,
+// then reports the score of the quad the next split takes. Returns false once
+// nothing is left to split.
+bool session_peek(Session *session, float error, float *score);
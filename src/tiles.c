@@ -0,0 +1,222 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "clock.h"
+#include "export.h"
+#include "heap.h"
+#include "render.h"
+#include "tiles.h"
+
+// The refinement a tile gets: every quad whose key is below `key`, plus `ties`
+// of those exactly at it, handed out to the tiles in order.
+typedef struct {
+    float key;
+    size_t ties;
+} TileLimit;
+
+// One image read band by band, each band a row of tiles.
+typedef struct {
+    Decoder decoder;
+    Image band;
+    const TileConfig *config;
+    TileReport *report;
+} TileReader;
+
+static bool tiles_open(TileReader *reader, const char *input, const TileConfig *config, TileReport *report) {
+    *reader = (TileReader) {
+        .config = config,
+        .report = report
+    };
+    return decoder_open(&reader->decoder, input, config->image.decoder);
+}
+
+// decodes the next band into `reader->band`, false at the end or on failure
+static bool tiles_next_band(TileReader *reader, bool *ok) {
+    image_free(&reader->band);
+
+    int left = reader->decoder.height - reader->decoder.row;
+    if (left <= 0) {
+        return false;
+    }
+
+    uint64_t start = clock_now_ns();
+    int rows = left < (int64_t)reader->config->size ? left : (int)reader->config->size;
+    *ok = image_read(&reader->band, &reader->decoder, rows, &reader->config->image);
+    reader->report->load += clock_now_ns() - start;
+    return *ok;
+}
+
+static void tiles_close(TileReader *reader) {
+    image_free(&reader->band);
+    decoder_close(&reader->decoder);
+}
+
+static Box tiles_box(const Image *band, uint32_t size, uint32_t column) {
+    uint64_t right = (uint64_t)(column + 1) * size;
+    return (Box) {
+        .left = column * size,
+        .right = right < (uint64_t)band->width ? right : (uint64_t)band->width,
+        .top = 0,
+        .bottom = band->height
+    };
+}
+
+static uint32_t tiles_columns(const Image *band, uint32_t size) {
+    return ((uint64_t)band->width + size - 1) / size;
+}
+
+// First pass: refines every tile on its own while its keys can still be among
+// the `count` smallest of the image, kept in a heap whose top is the largest.
+static bool tiles_select(const char *input, const TileConfig *config, size_t count, float error, TileLimit *limit, TileReport *report) {
+    if (count == 0) {
+        *limit = (TileLimit) { -INFINITY, 0 };
+        return true;
+    }
+
+    TileReader reader;
+    if (!tiles_open(&reader, input, config, report)) {
+        return false;
+    }
+
+    // scores are pushed negated, so the top holds the largest key
+    PackedHeap keys;
+    packed_heap_init(&keys, config->session.score);
+
+    bool ok = true;
+    while (ok && tiles_next_band(&reader, &ok)) {
+        uint32_t columns = tiles_columns(&reader.band, config->size);
+        for (uint32_t column = 0; column < columns && ok; column++) {
+            Box box = tiles_box(&reader.band, config->size, column);
+            Session session;
+            if (!session_init_region(&session, &reader.band, &box, &config->session)) {
+                ok = false;
+                break;
+            }
+
+            float key = -INFINITY;
+            float score;
+            while (session_peek(&session, error, &score)) {
+                key = score > key ? score : key;
+                if (keys.length == count) {
+                    // keys only grow, nothing else in this tile makes the cut
+                    if (key >= -keys.data[0].score) {
+                        break;
+                    }
+                    packed_heap_pop(&keys);
+                }
+
+                if (!packed_heap_push(&keys, 0, -key)) {
+                    fprintf(stderr, "Failed to allocate tile keys\n");
+                    ok = false;
+                    break;
+                }
+                if (session_refine(&session, 1, error) == 0) {
+                    break;
+                }
+            }
+
+            ok = ok && !session.out_of_memory;
+            session_deinit(&session);
+        }
+    }
+
+    if (ok && keys.length < count) {
+        // fewer splits than asked for exist, every tile refines completely
+        *limit = (TileLimit) { INFINITY, 0 };
+    } else if (ok) {
+        *limit = (TileLimit) { -keys.data[0].score, count };
+        for (size_t i = 0; i < keys.length; i++) {
+            if (-keys.data[i].score < limit->key) {
+                limit->ties--;
+            }
+        }
+    }
+
+    packed_heap_deinit(&keys);
+    tiles_close(&reader);
+    return ok;
+}
+
+// Second pass: refines each tile up to the limit, draws the band and writes it.
+static bool tiles_render(const char *input, const char *output, const TileConfig *config, float error, TileLimit *limit, TileReport *report) {
+    TileReader reader;
+    if (!tiles_open(&reader, input, config, report)) {
+        return false;
+    }
+
+    // rows of the output lie one row below the image rows, as the grid lines
+    // sit on the top and left edges of every box, the last row stays black
+    uint32_t width = reader.decoder.width;
+    uint32_t height = reader.decoder.height;
+    Framebuffer framebuffer;
+    if (!framebuffer_init(&framebuffer, width + PADDING, config->size < height ? config->size : height)) {
+        tiles_close(&reader);
+        return false;
+    }
+
+    Exporter exporter;
+    bool ok = export_begin(&exporter, output, width + PADDING, height + PADDING);
+    while (ok && tiles_next_band(&reader, &ok)) {
+        framebuffer.height = reader.band.height;
+        draw_rectangle(&framebuffer, 0, 0, framebuffer.width, framebuffer.height, 0xFF000000);
+
+        uint32_t columns = tiles_columns(&reader.band, config->size);
+        for (uint32_t column = 0; column < columns && ok; column++) {
+            Box box = tiles_box(&reader.band, config->size, column);
+            Session session;
+            if (!session_init_region(&session, &reader.band, &box, &config->session)) {
+                ok = false;
+                break;
+            }
+
+            float key = -INFINITY;
+            float score;
+            while (session_peek(&session, error, &score)) {
+                key = score > key ? score : key;
+                if (key > limit->key || (key == limit->key && limit->ties == 0)) {
+                    break;
+                }
+                if (key == limit->key) {
+                    limit->ties--;
+                }
+
+                if (session_refine(&session, 1, error) == 0) {
+                    break;
+                }
+            }
+
+            ok = !session.out_of_memory;
+            report->splits += session.splits;
+            render_split(&framebuffer, &session.root);
+            session_deinit(&session);
+        }
+
+        uint64_t start = clock_now_ns();
+        ok = ok && export_rows(&exporter, framebuffer.data, framebuffer.height);
+        report->write += clock_now_ns() - start;
+    }
+
+    if (ok) {
+        uint64_t start = clock_now_ns();
+        draw_rectangle(&framebuffer, 0, 0, framebuffer.width, PADDING, 0xFF000000);
+        ok = export_rows(&exporter, framebuffer.data, PADDING);
+        report->write += clock_now_ns() - start;
+    }
+    ok = export_end(&exporter) && ok;
+
+    framebuffer_deinit(&framebuffer);
+    tiles_close(&reader);
+    return ok;
+}
+
+bool tiles_run(const char *input, const char *output, const TileConfig *config, size_t count, float error, TileReport *report) {
+    *report = (TileReport) {0};
+
+    // without a split count every tile refines down to the error, no ordering needed
+    TileLimit limit = { INFINITY, 0 };
+    if (count != SIZE_MAX && !tiles_select(input, config, count, error, &limit, report)) {
+        return false;
+    }
+
+    return tiles_render(input, output, config, error, &limit, report);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "session.h"
+
+typedef struct {
+    // side of the square tiles
+    uint32_t size;
+    ImageConfig image;
+    SessionConfig session;
+} TileConfig;
+
+// time spent decoding and writing, in nanoseconds, and the splits made
+typedef struct {
+    uint64_t load;
+    uint64_t write;
+    size_t splits;
+} TileReport;
+
+// Refines the image at `input` as square tiles, each with its own session, and
+// writes the result to `output`. The image is decoded one band of tiles at a
+// time and each tile is refined, drawn into the band and freed in turn, so only
+// a band of pixels and a single tile's tree are ever resident.
+//
+// The splits still follow one global priority order: the key of a quad is the
+// worst score on its way down from its tile's root, and best-first refinement
+// takes quads in order of their keys, in every tile and over all of them. With
+// a split count a first pass over the bands finds the key of the `count`-th
+// split, and the second pass refines every tile up to that key. Quads below
+// `error` are retired as in session_refine.
+bool tiles_run(const char *input, const char *output, const TileConfig *config, size_t count, float error, TileReport *report);
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "moments.h"
+#include "score.h"
+#include "tree.h"
+
+static bool tree_reserve(Tree *tree, uint32_t length) {
+    if (length <= tree->capacity) {
+        return true;
+    }
+
+    uint32_t capacity = tree->capacity ? tree->capacity : 64;
+    while (capacity < length) {
+        if (capacity > UINT32_MAX / 2) {
+            capacity = UINT32_MAX - 1;
+            break;
+        }
+        capacity *= 2;
+    }
+    if (capacity < length) {
+        return false;
+    }
+
+    Box *boxes = realloc(tree->boxes, sizeof(Box) * capacity);
+    if (boxes) {
+        tree->boxes = boxes;
+    }
+    Color *colors = realloc(tree->colors, sizeof(Color) * capacity);
+    if (colors) {
+        tree->colors = colors;
+    }
+    float *errors = realloc(tree->errors, sizeof(float) * capacity);
+    if (errors) {
+        tree->errors = errors;
+    }
+    uint32_t *first_child = realloc(tree->first_child, sizeof(uint32_t) * capacity);
+    if (first_child) {
+        tree->first_child = first_child;
+    }
+
+    if (!boxes || !colors || !errors || !first_child) {
+        return false;
+    }
+
+    tree->capacity = capacity;
+    return true;
+}
+
+static void tree_set(Tree *tree, uint32_t node, const Box *box, const Moments *moments) {
+    AverageColor average_color = color_from_moments(moments);
+
+    tree->boxes[node] = *box;
+    tree->colors[node] = average_color.color;
+    tree->errors[node] = average_color.error;
+    tree->first_child[node] = TREE_NONE;
+}
+
+// appends four uninitialized nodes as the children of `node`
+static uint32_t tree_append_children(Tree *tree, uint32_t node) {
+    if (tree->length > UINT32_MAX - 5 || !tree_reserve(tree, tree->length + 4)) {
+        return TREE_NONE;
+    }
+
+    uint32_t first = tree->length;
+    tree->length += 4;
+    tree->first_child[node] = first;
+    return first;
+}
+
+bool tree_init(Tree *tree, const Image *image) {
+    *tree = (Tree) {
+        .image = image,
+        .min_leaf = 1
+    };
+
+    if (!tree_reserve(tree, 1)) {
+        fprintf(stderr, "Failed to malloc tree\n");
+        tree_deinit(tree);
+        return false;
+    }
+
+    Box box = { .left = 0, .right = image->width, .top = 0, .bottom = image->height };
+    Moments moments = box_moments(image, &box);
+    tree_set(tree, 0, &box, &moments);
+    tree->length = 1;
+
+    return true;
+}
+
+void tree_deinit(Tree *tree) {
+    free(tree->boxes);
+    free(tree->colors);
+    free(tree->errors);
+    free(tree->first_child);
+    tree->boxes = nullptr;
+    tree->colors = nullptr;
+    tree->errors = nullptr;
+    tree->first_child = nullptr;
+    tree->length = 0;
+    tree->capacity = 0;
+}
+
+static bool tree_build_node(Tree *tree, uint32_t node, const Box *box, uint32_t depth, Moments *moments) {
+    bool ok = true;
+    uint32_t first = TREE_NONE;
+    if (depth > 0 && box_can_split_to(box, tree->min_leaf)) {
+        first = tree_append_children(tree, node);
+        ok = first != TREE_NONE;
+    }
+
+    if (first == TREE_NONE) {
+        *moments = box_moments(tree->image, box);
+        tree_set(tree, node, box, moments);
+        return ok;
+    }
+
+    Box boxes[4];
+    box_split(box, boxes);
+
+    Moments merged = {0};
+    for (uint32_t i = 0; i < 4; i++) {
+        Moments child;
+        ok = tree_build_node(tree, first + i, &boxes[i], depth - 1, &child) && ok;
+        moments_merge(&merged, &child);
+    }
+
+    *moments = merged;
+    tree_set(tree, node, box, moments);
+    tree->first_child[node] = first;
+    return ok;
+}
+
+bool tree_build(Tree *tree, uint32_t depth) {
+    tree->length = 1;
+
+    Box box = tree->boxes[0];
+    Moments moments;
+    return tree_build_node(tree, 0, &box, depth, &moments);
+}
+
+bool tree_can_split(const Tree *tree, uint32_t node) {
+    return tree->first_child[node] == TREE_NONE && box_can_split_to(&tree->boxes[node], tree->min_leaf);
+}
+
+uint32_t tree_split(Tree *tree, uint32_t node) {
+    uint32_t first = tree_append_children(tree, node);
+    if (first == TREE_NONE) {
+        return TREE_NONE;
+    }
+
+    Box boxes[4];
+    box_split(&tree->boxes[node], boxes);
+
+    for (uint32_t i = 0; i < 4; i++) {
+        Moments moments = box_moments(tree->image, &boxes[i]);
+        tree_set(tree, first + i, &boxes[i], &moments);
+    }
+
+    return first;
+}
+
+static inline float tree_score(const Tree *tree, uint32_t node, const ScoreKind score) {
+    return score_quad(score, tree->errors[node], tree->colors[node], &tree->boxes[node]);
+}
+
+static inline bool tree_push(const Tree *tree, PackedHeap *heap, uint32_t node, const ScoreKind score) {
+    if (!tree_can_split(tree, node)) {
+        return true;
+    }
+
+    return packed_heap_push(heap, node, tree_score(tree, node, score));
+}
+
+bool tree_push_leaves(const Tree *tree, PackedHeap *heap) {
+    for (uint32_t node = 0; node < tree->length; node++) {
+        if (!tree_push(tree, heap, node, heap->score)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// inlined once per score kind, see heap_push_scored
+static inline size_t tree_refine_scored(Tree *tree, PackedHeap *heap, size_t count, float error, bool *out_of_memory, const ScoreKind score) {
+    size_t splits = 0;
+    *out_of_memory = false;
+
+    while (splits < count && heap->length > 0) {
+        // leaves below the threshold are retired, see session_refine
+        uint32_t node = packed_heap_pop(heap);
+        if (tree->errors[node] < error) {
+            continue;
+        }
+
+        uint32_t first = tree_split(tree, node);
+        if (first == TREE_NONE) {
+            packed_heap_push(heap, node, tree_score(tree, node, score));
+            *out_of_memory = true;
+            break;
+        }
+        splits++;
+
+        for (uint32_t i = 0; i < 4; i++) {
+            if (tree->errors[first + i] < error) {
+                continue;
+            }
+            if (!tree_push(tree, heap, first + i, score)) {
+                *out_of_memory = true;
+                return splits;
+            }
+        }
+    }
+
+    return splits;
+}
+
+size_t tree_refine(Tree *tree, PackedHeap *heap, size_t count, float error, bool *out_of_memory) {
+    switch (heap->score) {
+        case SCORE_ERROR:
+            return tree_refine_scored(tree, heap, count, error, out_of_memory, SCORE_ERROR);
+        case SCORE_AREA:
+            return tree_refine_scored(tree, heap, count, error, out_of_memory, SCORE_AREA);
+        case SCORE_SQRT_AREA:
+            return tree_refine_scored(tree, heap, count, error, out_of_memory, SCORE_SQRT_AREA);
+        case SCORE_PERCEPTUAL:
+            return tree_refine_scored(tree, heap, count, error, out_of_memory, SCORE_PERCEPTUAL);
+        case SCORE_ROOT4_AREA:
+        default:
+            return tree_refine_scored(tree, heap, count, error, out_of_memory, SCORE_ROOT4_AREA);
+    }
+}
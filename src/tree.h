@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "heap.h"
+#include "quad.h"
+
+#define TREE_NONE UINT32_MAX
+
+// Index based quadtree stored as a structure of arrays. Node 0 is the root, the
+// four children of a node are always consecutive starting at first_child (top
+// left, top right, bottom left, bottom right) and leaves have TREE_NONE there.
+// A node costs 27 bytes spread over streams that the renderer and the scoring
+// passes read linearly, against 48 bytes for a pointer based Quad.
+typedef struct {
+    const Image *image;
+    Box *boxes;
+    Color *colors;
+    float *errors;
+    uint32_t *first_child;
+    uint32_t length;
+    uint32_t capacity;
+    // refinement only splits nodes whose children keep at least this many
+    // pixels per side, 1 after tree_init
+    uint32_t min_leaf;
+} Tree;
+
+// creates the tree with just the root covering the whole image
+bool tree_init(Tree *tree, const Image *image);
+void tree_deinit(Tree *tree);
+
+// Builds every level down to `depth` bottom-up from a fresh root, never leaving
+// a node under `min_leaf` pixels per side. Only the deepest nodes read pixels
+// and parents merge their children's moments.
+bool tree_build(Tree *tree, uint32_t depth);
+
+bool tree_can_split(const Tree *tree, uint32_t node);
+// returns the index of the first child, or TREE_NONE when out of memory
+uint32_t tree_split(Tree *tree, uint32_t node);
+
+// pushes every leaf that can still be split, scored with the heap's score kind
+bool tree_push_leaves(const Tree *tree, PackedHeap *heap);
+
+// Splits the highest priority leaves until `count` splits were made, the heap ran
+// out or memory ran out, in which case `out_of_memory` is set. Leaves with an
+// error below `error` are dropped from the heap unsplit. Returns the number of
+// splits performed.
+size_t tree_refine(Tree *tree, PackedHeap *heap, size_t count, float error, bool *out_of_memory);